@@ -0,0 +1,157 @@
+#include "InterproceduralDefUseAnalysis.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/Timer.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFile(cl::Positional, cl::desc("<input bitcode>"), cl::Required);
+static cl::opt<std::string> Entry("entry", cl::desc("Only read this function and the ones it calls, directly or not. Queries leaving them "
+                                                    "for callers that are not read are lost. Empty (the default) reads every function, "
+                                                    "like the pass"));
+static cl::opt<bool> TimePhases("time-phases", cl::desc("Report how long each phase took"), cl::init(true));
+static cl::opt<unsigned> DDUThreads("ddu-threads", cl::desc("Number of threads analyzing functions in parallel"), cl::init(1));
+static cl::opt<std::string> DDUCache("ddu-cache", cl::desc("File keeping each function's results between runs, reused while the functions they depend on are unchanged"),
+                                      cl::value_desc("path"));
+static cl::opt<bool> DDUBatchVariables("ddu-batch-variables", cl::desc("Walk the local variables loaded at the same node together"), cl::init(true));
+static cl::opt<unsigned> DDUMaxSteps("ddu-max-detection-steps", cl::desc("Step 1 work items the detection in each function may take, 0 for no limit"),
+                                     cl::init(0));
+static cl::opt<unsigned> DDUMaxVisits("ddu-max-visits", cl::desc("(node, query) visits the detection in each function may make, 0 for no limit"),
+                                      cl::init(0));
+static cl::opt<unsigned> DDUMaxCallDepth("ddu-max-call-depth", cl::desc("How deep the detection may follow calls: 1 enters callees but not the functions they call, 0 for no limit"),
+                                         cl::init(0));
+static cl::opt<double> DDUMaxSeconds("ddu-max-detection-seconds", cl::desc("Seconds the detection in each function may take, 0 for no limit"),
+                                     cl::init(0));
+static cl::opt<unsigned> DDUMaxWalkSteps("ddu-max-walk-steps", cl::desc("Work items each def-use walk may take, 0 for no limit"), cl::init(0));
+static cl::opt<double> DDUMaxWalkSeconds("ddu-max-walk-seconds", cl::desc("Seconds each def-use walk may take, 0 for no limit"), cl::init(0));
+static cl::opt<OutputFormat> DDUOutput("ddu-output", cl::desc("How the def-use pairs are written"), outputFormatValues(), cl::init(OutputText));
+static cl::opt<std::string> DDUOutputFile("ddu-output-file", cl::desc("File the def-use pairs are written to, - for stdout (default: stderr)"),
+                                          cl::value_desc("path"));
+
+namespace {
+
+  DetectionBudget detectionBudget() {
+    DetectionBudget budget;
+    budget.steps = DDUMaxSteps;
+    budget.visits = DDUMaxVisits;
+    budget.callDepth = DDUMaxCallDepth;
+    budget.seconds = DDUMaxSeconds;
+    return budget;
+  }
+
+  WalkBudget walkBudget() {
+    WalkBudget budget;
+    budget.steps = DDUMaxWalkSteps;
+    budget.seconds = DDUMaxWalkSeconds;
+    return budget;
+  }
+
+  // Materializes entry and every function it calls, directly or not. The ICFG only has nodes for the
+  // call sites of functions that were read, so queries that leave one of them through its entry do
+  // not reach callers outside this set. Functions left unread are not analyzed. Returns false if a
+  // function body could not be read.
+  bool materializeCallees(Function& entry, unsigned& numberOfFunctions) {
+    std::vector<Function*> worklist(1, &entry);
+    SmallPtrSet<Function*, 32> reached;
+    reached.insert(&entry);
+    while (!worklist.empty()) {
+      Function* F = worklist.back();
+      worklist.pop_back();
+      if (Error error = F->materialize()) {
+        errs() << "[!] Could not read " << F->getName() << ": " << toString(std::move(error)) << "\n";
+        return false;
+      }
+      for (BasicBlock& B : *F) {
+        for (Instruction& I : B) {
+          CallInst* call = dyn_cast<CallInst>(&I);
+          Function* callee = call != nullptr ? call->getCalledFunction() : nullptr;
+          if (callee != nullptr && callee->isMaterializable() && reached.insert(callee).second) {
+            worklist.push_back(callee);
+          }
+        }
+      }
+    }
+    numberOfFunctions = reached.size();
+    return true;
+  }
+
+}
+
+// Runs the interprocedural infeasible path detection and def-use queries on a bitcode file without
+// opt. Function bodies are read lazily, so with -entry only the part of the program reachable from
+// it is ever parsed.
+int main(int argc, char** argv) {
+  llvm_shutdown_obj shutdown;
+  cl::ParseCommandLineOptions(argc, argv, "Infeasible paths and def-use pairs of a program\n");
+
+  TimerGroup phases("phases", "Analysis phases");
+  Timer loading("load", "Reading the module", phases);
+  Timer materializing("materialize", "Reading the reachable functions", phases);
+  Timer detection("detect", "Infeasible path detection", phases);
+  Timer queries("def-use", "Def-use queries", phases);
+  Timer writing("write", "Writing the results", phases);
+
+  LLVMContext context;
+  SMDiagnostic diagnostic;
+  std::unique_ptr<Module> module;
+  {
+    TimeRegion region(TimePhases ? &loading : nullptr);
+    module = getLazyIRFileModule(InputFile, diagnostic, context);
+  }
+  if (!module) {
+    diagnostic.print(argv[0], errs());
+    return 1;
+  }
+
+  {
+    TimeRegion region(TimePhases ? &materializing : nullptr);
+    Function* entry = Entry.empty() ? nullptr : module->getFunction(Entry);
+    unsigned numberOfFunctions = 0;
+    if (entry != nullptr && entry->isMaterializable()) {
+      if (!materializeCallees(*entry, numberOfFunctions)) {
+        return 1;
+      }
+      unsigned numberOfBodies = 0;
+      for (Function& F : *module) {
+        if (!F.isDeclaration()) {
+          ++numberOfBodies;
+        }
+      }
+      errs() << "[*] Read " << numberOfFunctions << " of " << numberOfBodies << " function bodies\n";
+    }
+    else {
+      if (!Entry.empty()) {
+        errs() << "[!] No function " << Entry << " to start at, reading every function\n";
+      }
+      if (Error error = module->materializeAll()) {
+        errs() << "[!] Could not read " << InputFile << ": " << toString(std::move(error)) << "\n";
+        return 1;
+      }
+    }
+  }
+
+  std::unique_ptr<ModuleInfeasiblePathInfo> info;
+  {
+    TimeRegion region(TimePhases ? &detection : nullptr);
+    info.reset(new ModuleInfeasiblePathInfo(ModuleInfeasiblePathAnalysis::compute(*module, DDUThreads, DDUCache, detectionBudget())));
+  }
+
+  ModuleDefUses defUses;
+  {
+    TimeRegion region(TimePhases ? &queries : nullptr);
+    defUses = ModuleDefUseAnalysis::compute(*module, *info, DDUThreads, DDUBatchVariables, walkBudget());
+  }
+  printBudgetFallbacks(*info, defUses, errs());
+
+  {
+    TimeRegion region(TimePhases ? &writing : nullptr);
+    saveResultCache(*info, errs());
+    ResultWriter writer(DDUOutput, DDUOutputFile);
+    writeDefUses(writer, *module, defUses);
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+#include "Benchmark.h"
+#include "SyntheticModule.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+enum ScaledDimension { ScaleBranches, ScaleLoops, ScaleCallDepth, ScaleFanIn };
+enum BenchmarkEngines { IntraproceduralEngine, InterproceduralEngine, BothEngines };
+
+static cl::list<unsigned> Sizes("sizes", cl::desc("Values the scaled dimension takes, one module each (default: 1,2,4,8,16)"), cl::CommaSeparated);
+static cl::opt<ScaledDimension> Scale("scale", cl::desc("Dimension of the module that takes each of -sizes"),
+                                      cl::values(clEnumValN(ScaleBranches, "branches", "Correlated branch pairs per function"),
+                                                 clEnumValN(ScaleLoops, "loops", "Depth of the loop nest"),
+                                                 clEnumValN(ScaleCallDepth, "call-depth", "Length of the call chain below main"),
+                                                 clEnumValN(ScaleFanIn, "fan-in", "Call sites of each function in its caller")),
+                                      cl::init(ScaleBranches));
+static cl::opt<unsigned> Branches("branches", cl::desc("Correlated branch pairs per function"), cl::init(4));
+static cl::opt<unsigned> Loops("loops", cl::desc("Depth of the loop nest around the branches"), cl::init(1));
+static cl::opt<unsigned> CallDepth("call-depth", cl::desc("Length of the call chain below main"), cl::init(2));
+static cl::opt<unsigned> FanIn("fan-in", cl::desc("Call sites of each function in its caller"), cl::init(1));
+static cl::opt<bool> Recursion("recursion", cl::desc("Make the last function of the chain call itself"), cl::init(false));
+static cl::opt<BenchmarkEngines> Engines("engine", cl::desc("Engines to run"),
+                                         cl::values(clEnumValN(IntraproceduralEngine, "intra", "Intraprocedural detector and def-use"),
+                                                    clEnumValN(InterproceduralEngine, "inter", "Interprocedural detector and def-use"),
+                                                    clEnumValN(BothEngines, "both", "Both")),
+                                         cl::init(BothEngines));
+static cl::opt<unsigned> Threads("ddu-threads", cl::desc("Threads of the interprocedural engine"), cl::init(1));
+static cl::opt<bool> PrintModules("print-modules", cl::desc("Print the module of each size as LLVM assembly instead of running the engines"),
+                                  cl::init(false));
+
+namespace {
+
+  SyntheticModuleShape shapeOfSize(unsigned size) {
+    SyntheticModuleShape shape = { Branches, Loops, CallDepth, FanIn, Recursion };
+    switch (Scale) {
+    case ScaleBranches:
+      shape.correlatedBranches = size;
+      break;
+    case ScaleLoops:
+      shape.loopDepth = size;
+      break;
+    case ScaleCallDepth:
+      shape.callDepth = size;
+      break;
+    case ScaleFanIn:
+      shape.fanIn = size;
+      break;
+    }
+    return shape;
+  }
+
+  // Generates the module of the given size, runs one engine on it and prints a row of the table.
+  // Runs in a process of its own, so the peak RSS is that of this module alone.
+  int runCase(unsigned size, bool interprocedural) {
+    LLVMContext context;
+    std::unique_ptr<Module> module = SyntheticModuleBuilder(context, shapeOfSize(size)).build();
+    if (verifyModule(*module, &errs())) {
+      errs() << "[!] Generated an invalid module\n";
+      return 1;
+    }
+
+    unsigned numberOfBlocks = 0;
+    for (Function& F : *module) {
+      numberOfBlocks += F.size();
+    }
+
+    BenchmarkResult result;
+    if (interprocedural) {
+      runInterproceduralBenchmark(*module, Threads, result);
+    }
+    else {
+      runIntraproceduralBenchmark(*module, result);
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const char* engine = interprocedural ? "inter" : "intra";
+    outs() << format("%-6s %6u %10u %7u %7u %8u %9u %7u %10.4f %11.4f %13ld\n", engine, size,
+                     (unsigned)module->size(), numberOfBlocks, result.nodes, result.queries, result.setElements, result.pairs,
+                     result.detectionSeconds, result.defUseSeconds, usage.ru_maxrss);
+    outs().flush();
+    return 0;
+  }
+
+}
+
+// Generates modules of growing size and reports how long detection and the def-use queries take
+// on them, how much memory they peak at, and how many nodes, queries, set elements and pairs they
+// produce. A regression in how one of them scales shows up as a change in the slope of its column.
+int main(int argc, char** argv) {
+  llvm_shutdown_obj shutdown;
+  cl::ParseCommandLineOptions(argc, argv, "Infeasible path and def-use benchmark on generated modules\n");
+
+  std::vector<unsigned> sizes(Sizes.begin(), Sizes.end());
+  if (sizes.empty()) {
+    sizes = { 1, 2, 4, 8, 16 };
+  }
+
+  // The test programs under test/test_synthetic_*.ll were printed this way.
+  if (PrintModules) {
+    for (unsigned size : sizes) {
+      LLVMContext context;
+      SyntheticModuleBuilder(context, shapeOfSize(size)).build()->print(outs(), nullptr);
+    }
+    return 0;
+  }
+
+  outs() << "engine   size  functions  blocks   nodes  queries  elements   pairs  detect(s)  def-use(s)  peak RSS(KB)\n";
+  int status = 0;
+  for (unsigned size : sizes) {
+    for (unsigned engine = IntraproceduralEngine; engine <= InterproceduralEngine; ++engine) {
+      if (Engines != BothEngines && Engines != engine) {
+        continue;
+      }
+
+      outs().flush();
+      pid_t child = fork();
+      if (child == 0) {
+        _exit(runCase(size, engine == InterproceduralEngine));
+      }
+      int childStatus;
+      if (child < 0 || waitpid(child, &childStatus, 0) != child || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+        errs() << "[!] Size " << size << " failed on the " << (engine == InterproceduralEngine ? "inter" : "intra") << "procedural engine\n";
+        status = 1;
+      }
+    }
+  }
+  return status;
+}
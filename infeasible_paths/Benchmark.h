@@ -0,0 +1,25 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include "llvm/IR/Module.h"
+
+using namespace llvm;
+
+// What one engine did on one module. The intraprocedural and interprocedural detectors share
+// their names, so each engine is run from its own translation unit.
+struct BenchmarkResult {
+  // Blocks for the intraprocedural engine, ICFG nodes for the interprocedural one
+  unsigned nodes = 0;
+  unsigned queries = 0;
+  // Elements of the start, present and end sets of every branch
+  unsigned setElements = 0;
+  unsigned pairs = 0;
+  double detectionSeconds = 0;
+  double defUseSeconds = 0;
+};
+
+// Detects the infeasible paths of every function of M and then finds its def-use pairs.
+void runIntraproceduralBenchmark(Module& M, BenchmarkResult& result);
+void runInterproceduralBenchmark(Module& M, unsigned numberOfThreads, BenchmarkResult& result);
+
+#endif
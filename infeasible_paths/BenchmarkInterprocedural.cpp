@@ -0,0 +1,39 @@
+#include "Benchmark.h"
+#include "InterproceduralDefUseAnalysis.h"
+
+#include "llvm/Support/Timer.h"
+
+void runInterproceduralBenchmark(Module& M, unsigned numberOfThreads, BenchmarkResult& result) {
+  TimeRecord detectionStart = TimeRecord::getCurrentTime(true);
+  ModuleInfeasiblePathInfo info = ModuleInfeasiblePathAnalysis::compute(M, numberOfThreads);
+  TimeRecord detection = TimeRecord::getCurrentTime(false);
+  detection -= detectionStart;
+  result.detectionSeconds = detection.getWallTime();
+
+  TimeRecord defUseStart = TimeRecord::getCurrentTime(true);
+  ModuleDefUses defUses = ModuleDefUseAnalysis::compute(M, info, numberOfThreads, true);
+  TimeRecord defUse = TimeRecord::getCurrentTime(false);
+  defUse -= defUseStart;
+  result.defUseSeconds = defUse.getWallTime();
+
+  result.nodes = info.graph->size();
+  for (const std::unique_ptr<ModuleQueryState>& state : info.states) {
+    result.queries += state->queries.size();
+  }
+  for (const std::pair<Node* const, InfeasiblePathResult>& branch : info.paths.branchResults) {
+    for (const auto& edge : branch.second.startSet) {
+      result.setElements += edge.second.size();
+    }
+    for (const auto& edge : branch.second.presentSet) {
+      result.setElements += edge.second.size();
+    }
+    for (const auto& edge : branch.second.endSet) {
+      result.setElements += edge.second.size();
+    }
+  }
+  for (const DefUseMap& pairs : defUses.defUses) {
+    for (unsigned variable = 0; variable < pairs.numberOfVariables(); ++variable) {
+      result.pairs += pairs.getDefUses(variable).size();
+    }
+  }
+}
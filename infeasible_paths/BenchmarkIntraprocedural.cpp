@@ -0,0 +1,47 @@
+#include "Benchmark.h"
+#include "DemandDrivenDefUseAnalysis.h"
+
+#include "llvm/Support/Timer.h"
+
+void runIntraproceduralBenchmark(Module& M, BenchmarkResult& result) {
+  std::vector<FunctionInfeasiblePaths> paths;
+  TimeRecord detectionStart = TimeRecord::getCurrentTime(true);
+  for (Function& F : M) {
+    paths.push_back(InfeasiblePathAnalysis::compute(F));
+  }
+  TimeRecord detection = TimeRecord::getCurrentTime(false);
+  detection -= detectionStart;
+  result.detectionSeconds = detection.getWallTime();
+
+  TimeRecord defUseStart = TimeRecord::getCurrentTime(true);
+  std::vector<FunctionDefUses> defUses;
+  unsigned function = 0;
+  for (Function& F : M) {
+    defUses.push_back(DefUseAnalysis::compute(F, paths[function++], true));
+  }
+  TimeRecord defUse = TimeRecord::getCurrentTime(false);
+  defUse -= defUseStart;
+  result.defUseSeconds = defUse.getWallTime();
+
+  function = 0;
+  for (Function& F : M) {
+    result.nodes += F.size();
+    result.queries += paths[function].queries->size();
+    for (const std::pair<BasicBlock* const, InfeasiblePathResult>& branch : paths[function].branchResults) {
+      for (const auto& edge : branch.second.startSet) {
+        result.setElements += edge.second.size();
+      }
+      for (const auto& edge : branch.second.presentSet) {
+        result.setElements += edge.second.size();
+      }
+      for (const auto& edge : branch.second.endSet) {
+        result.setElements += edge.second.size();
+      }
+    }
+    const DefUseMap& pairs = defUses[function].defUses;
+    for (unsigned variable = 0; variable < pairs.numberOfVariables(); ++variable) {
+      result.pairs += pairs.getDefUses(variable).size();
+    }
+    ++function;
+  }
+}
@@ -0,0 +1,116 @@
+#ifndef CALLSITEINDEX_H_
+#define CALLSITEINDEX_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include <vector>
+
+using namespace llvm;
+
+// Module-wide index of calls to functions that have a body, built once before the ICFG is. For
+// every block it keeps the defined-function calls in program order, and for every function its
+// call sites and exit blocks, so nodes never have to rescan instruction lists or use lists.
+class CallSiteIndex {
+public:
+  explicit CallSiteIndex(Module& m) {
+    for (Function& f : m) {
+      if (f.isDeclaration()) {
+        continue;
+      }
+      for (BasicBlock& b : f) {
+        std::vector<Instruction*>& calls = callsInBlock[&b];
+        for (Instruction& i : b) {
+          CallInst* callInst = dyn_cast<CallInst>(&i);
+          if (callInst == nullptr || callInst->getCalledFunction() == nullptr || callInst->getCalledFunction()->isDeclaration()) {
+            continue;
+          }
+          callPosition[&i] = calls.size();
+          calls.push_back(&i);
+          callSites[callInst->getCalledFunction()].push_back(callInst);
+        }
+        if (b.getTerminator()->getNumSuccessors() == 0) {
+          exitBlocks[&f].push_back(&b);
+        }
+      }
+    }
+  }
+
+  bool isDefinedCall(const Instruction* i) const {
+    return i != nullptr && callPosition.count(i) > 0;
+  }
+
+  ArrayRef<Instruction*> getCallsIn(const BasicBlock* b) const {
+    DenseMap<const BasicBlock*, std::vector<Instruction*>>::const_iterator callsIter = callsInBlock.find(b);
+    if (callsIter == callsInBlock.end()) {
+      return ArrayRef<Instruction*>();
+    }
+    return callsIter->second;
+  }
+
+  Instruction* getFirstCallIn(const BasicBlock* b) const {
+    ArrayRef<Instruction*> calls = getCallsIn(b);
+    return calls.empty() ? nullptr : calls.front();
+  }
+
+  Instruction* getLastCallIn(const BasicBlock* b) const {
+    ArrayRef<Instruction*> calls = getCallsIn(b);
+    return calls.empty() ? nullptr : calls.back();
+  }
+
+  // Call following the defined call `call` in its block, or nullptr if it is the last one.
+  Instruction* getNextCallAfter(const Instruction* call) const {
+    ArrayRef<Instruction*> calls = getCallsIn(call->getParent());
+    unsigned position = callPosition.lookup(call);
+    return position + 1 < calls.size() ? calls[position + 1] : nullptr;
+  }
+
+  // Call preceding the defined call `call` in its block, or nullptr if it is the first one.
+  Instruction* getPreviousCallBefore(const Instruction* call) const {
+    unsigned position = callPosition.lookup(call);
+    return position > 0 ? getCallsIn(call->getParent())[position - 1] : nullptr;
+  }
+
+  // First defined call strictly after i in its block, or nullptr if there is none.
+  Instruction* getCallFollowing(Instruction* i) const {
+    if (isDefinedCall(i)) {
+      return getNextCallAfter(i);
+    }
+    if (getCallsIn(i->getParent()).empty()) {
+      return nullptr;
+    }
+    for (BasicBlock::iterator iIter = ++(i->getIterator()); iIter != i->getParent()->end(); ++iIter) {
+      if (isDefinedCall(&(*iIter))) {
+        return &(*iIter);
+      }
+    }
+    return nullptr;
+  }
+
+  ArrayRef<CallInst*> getCallSitesOf(const Function* f) const {
+    DenseMap<const Function*, std::vector<CallInst*>>::const_iterator callSitesIter = callSites.find(f);
+    if (callSitesIter == callSites.end()) {
+      return ArrayRef<CallInst*>();
+    }
+    return callSitesIter->second;
+  }
+
+  ArrayRef<BasicBlock*> getExitBlocksOf(const Function* f) const {
+    DenseMap<const Function*, std::vector<BasicBlock*>>::const_iterator exitIter = exitBlocks.find(f);
+    if (exitIter == exitBlocks.end()) {
+      return ArrayRef<BasicBlock*>();
+    }
+    return exitIter->second;
+  }
+
+private:
+  DenseMap<const BasicBlock*, std::vector<Instruction*>> callsInBlock;
+  DenseMap<const Instruction*, unsigned> callPosition;
+  DenseMap<const Function*, std::vector<CallInst*>> callSites;
+  DenseMap<const Function*, std::vector<BasicBlock*>> exitBlocks;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef CALLSTRINGTRIE_H_
+#define CALLSTRINGTRIE_H_
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+struct Node;
+
+typedef unsigned CallContext;
+
+const CallContext EmptyContext = 0;
+
+// Calling contexts as nodes of a shared trie. A context is the ID of its innermost call: each entry
+// stores the call site node and the context it was pushed onto, and equal call strings always get
+// the same ID. Push, pop and top are O(1) and a context costs one entry however deep it is.
+class CallStringTrie {
+public:
+  CallStringTrie() {
+    Entry root = { nullptr, EmptyContext, 0 };
+    entries.push_back(root);
+  }
+
+  CallStringTrie(const CallStringTrie&) = delete;
+  CallStringTrie& operator=(const CallStringTrie&) = delete;
+
+  CallContext push(CallContext context, Node* callSite) {
+    std::pair<DenseMap<std::pair<CallContext, Node*>, CallContext>::iterator, bool> inserted =
+      children.insert(std::make_pair(std::make_pair(context, callSite), (CallContext)entries.size()));
+    if (inserted.second) {
+      Entry entry = { callSite, context, entries[context].depth + 1 };
+      entries.push_back(entry);
+    }
+    return inserted.first->second;
+  }
+
+  CallContext pop(CallContext context) const {
+    return entries[context].parent;
+  }
+
+  Node* top(CallContext context) const {
+    return entries[context].callSite;
+  }
+
+  unsigned depth(CallContext context) const {
+    return entries[context].depth;
+  }
+
+  bool empty(CallContext context) const {
+    return context == EmptyContext;
+  }
+
+  // True if the innermost calls of context are exactly the call string calls, i.e. calls is a
+  // top-aligned prefix of context when both are read as stacks.
+  bool endsWith(CallContext context, CallContext calls) const {
+    if (depth(calls) > depth(context)) {
+      return false;
+    }
+    while (calls != EmptyContext) {
+      if (context == calls) {
+        return true;
+      }
+      if (top(context) != top(calls)) {
+        return false;
+      }
+      context = pop(context);
+      calls = pop(calls);
+    }
+    return true;
+  }
+
+  // endsWith for a call string of another trie. IDs only mean something in their own trie, so the
+  // two are compared call site by call site.
+  bool endsWith(CallContext context, const CallStringTrie& callsTrie, CallContext calls) const {
+    if (&callsTrie == this) {
+      return endsWith(context, calls);
+    }
+    if (callsTrie.depth(calls) > depth(context)) {
+      return false;
+    }
+    while (calls != EmptyContext) {
+      if (top(context) != callsTrie.top(calls)) {
+        return false;
+      }
+      context = pop(context);
+      calls = callsTrie.pop(calls);
+    }
+    return true;
+  }
+
+private:
+  struct Entry {
+    Node* callSite;
+    CallContext parent;
+    unsigned depth;
+  };
+
+  std::vector<Entry> entries;
+  DenseMap<std::pair<CallContext, Node*>, CallContext> children;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DEFUSEMAP_H_
+#define DEFUSEMAP_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Value.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+// Def-use pairs per variable. Variables are keyed on their Value and numbered densely in the order
+// they are first given a pair, and each keeps its pairs in a sorted vector. Names are only looked
+// at when the pairs are printed, so variables that share a name stay apart.
+class DefUseMap {
+public:
+  typedef std::pair<BasicBlock*, BasicBlock*> DefUse;
+
+  void insert(Value* variable, DefUse defUse) {
+    std::vector<DefUse>& pairs = defUses[getVariableID(variable)];
+    std::vector<DefUse>::iterator position = std::lower_bound(pairs.begin(), pairs.end(), defUse);
+    if (position == pairs.end() || *position != defUse) {
+      pairs.insert(position, defUse);
+    }
+  }
+
+  // Adds the pairs other has for variable.
+  void insertAll(const DefUseMap& other, Value* variable) {
+    for (DefUse defUse : other.getDefUses(variable)) {
+      insert(variable, defUse);
+    }
+  }
+
+  ArrayRef<DefUse> getDefUses(Value* variable) const {
+    DenseMap<Value*, unsigned>::const_iterator id = ids.find(variable);
+    if (id == ids.end()) {
+      return ArrayRef<DefUse>();
+    }
+    return defUses[id->second];
+  }
+
+  unsigned numberOfVariables() const {
+    return variables.size();
+  }
+
+  Value* getVariable(unsigned id) const {
+    return variables[id];
+  }
+
+  ArrayRef<DefUse> getDefUses(unsigned id) const {
+    return defUses[id];
+  }
+
+  // Variable IDs in the order results are printed: by name, then by ID among equal names.
+  std::vector<unsigned> getVariablesByName() const {
+    std::vector<unsigned> order(variables.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](unsigned a, unsigned b) {
+      return variables[a]->getName() < variables[b]->getName();
+    });
+    return order;
+  }
+
+private:
+  DenseMap<Value*, unsigned> ids;
+  std::vector<Value*> variables;
+  std::vector<std::vector<DefUse>> defUses;
+
+  unsigned getVariableID(Value* variable) {
+    std::pair<DenseMap<Value*, unsigned>::iterator, bool> inserted = ids.insert(std::make_pair(variable, (unsigned)variables.size()));
+    if (inserted.second) {
+      variables.push_back(variable);
+      defUses.push_back(std::vector<DefUse>());
+    }
+    return inserted.first->second;
+  }
+};
+
+#endif
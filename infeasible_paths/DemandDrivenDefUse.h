@@ -2,26 +2,80 @@
 #define DEMANDDRIVENDEFUSE_H_
 
 #include "InfeasiblePathDetector.h"
+#include "IPPSet.h"
+#include "DefUseMap.h"
+#include "StoreIndex.h"
+
+#include <memory>
 
 using namespace llvm;
 using namespace std;
 
+#define DEBUG_TYPE "def-use"
+
 namespace{
 
+	STATISTIC(NumDefUseWalks, "Def-use queries walked");
+	STATISTIC(NumDefUseItems, "Work items taken off the def-use worklist");
+	STATISTIC(NumDefUseEdges, "Edges followed by def-use walks");
+
   class DemandDrivenDefUse { 
   private:
 
   public:
+		// Queries the detected sets refer to, owned unless they were detected beforehand
+		unique_ptr<QueryInterner<Query>> ownQueries;
 		InfeasiblePathResult result;
 		InfeasiblePathDetector detector;
 
-    DemandDrivenDefUse() {}
+		// Start/present/end sets of each edge as bitsets, rebuilt whenever result grows
+		map<pair<BasicBlock*, BasicBlock*>, EdgeIPPSets> edgeSets;
+
+		// Scratch set for renaming, reused across edges
+		IPPSet renamed;
+
+		// Infeasible paths of each conditional branch of the function, detected in one batch
+		map<BasicBlock*, InfeasiblePathResult> ownBranchResults;
+		const map<BasicBlock*, InfeasiblePathResult> *branchResults;
+
+		// Last store to each variable in each block of the function
+		StoreIndex<BasicBlock*> stores;
+
+		Function *analyzedFunction;
+
+		// Walk all variables loaded in a block together instead of one at a time
+		bool batchVariables;
+
+		// Block, paths in progress, and the variables whose walks reached the block with them
+		typedef tuple<BasicBlock*, IPPSet, BitVector> WorkItem;
 
-		void startBlockAnalysis(BasicBlock& B, map<string, set<pair<BasicBlock*, BasicBlock*>>>& def_use){		
+    explicit DemandDrivenDefUse(bool batchVariables)
+      : ownQueries(new QueryInterner<Query>()), detector(*ownQueries), branchResults(&ownBranchResults), analyzedFunction(nullptr),
+        batchVariables(batchVariables) {}
+
+    // Queries the def-uses of F against infeasible paths detected beforehand, such as a cached
+    // InfeasiblePathAnalysis result. queries must be the interner those sets refer to.
+    DemandDrivenDefUse(Function& F, QueryInterner<Query>& queries, const map<BasicBlock*, InfeasiblePathResult>& branchResults,
+                       bool batchVariables)
+      : detector(queries), branchResults(&branchResults), analyzedFunction(&F), batchVariables(batchVariables) {
+      indexStores(F);
+    }
+
+		void startBlockAnalysis(BasicBlock& B, DefUseMap& def_use){		
 			
-      detector.detectPaths(B, result);
+			if (analyzedFunction != B.getParent()){
+				assert(ownQueries && "branches detected beforehand only cover their own function");
+				detectBranches(*B.getParent());
+				indexStores(*B.getParent());
+				analyzedFunction = B.getParent();
+			}
+			map<BasicBlock*, InfeasiblePathResult>::const_iterator branchResult = branchResults->find(&B);
+			if (branchResult != branchResults->end())
+				result.merge(branchResult->second);
+			edgeSets.clear();
 
 			set<Value*> local_def; 
+			vector<Value*> variables;
 
 			// Iterate over used variables, call demand driven analysis on each 
 			for(BasicBlock::iterator ins = B.begin(); ins != B.end(); ++ins)
@@ -35,122 +89,155 @@ namespace{
 								if(op->hasName()){
 									// Is it locally defined?
 									if(local_def.find(op) != local_def.end())
-										def_use[op->getName()].insert(make_pair(&B, &B));
-									else
+										def_use.insert(op, make_pair(&B, &B));
+									else if(!batchVariables)
 										demandDrivenDefUseAnalysis(def_use, *op, B);
+									else if(find(variables.begin(), variables.end(), op) == variables.end())
+										variables.push_back(op);
 								}
 					}								
 
+			if(!variables.empty())
+				demandDrivenDefUseAnalysis(def_use, variables, B);
+		}
+
+
+		void detectBranches(Function& F){
+			vector<BasicBlock*> branchBlocks;
+			for(BasicBlock& B : F)
+				branchBlocks.push_back(&B);
+
+			vector<InfeasiblePathResult> results;
+			detector.detectPaths(branchBlocks, results);
+			ownBranchResults.clear();
+			for(unsigned i = 0; i < branchBlocks.size(); ++i)
+				ownBranchResults[branchBlocks[i]].merge(results[i]);
+		}
+
+		void indexStores(Function& F){
+			stores.clear();
+			for(BasicBlock& B : F)
+				for(Instruction& i : B)
+					stores.add(&B, &i);
+		}
+
+		void demandDrivenDefUseAnalysis(DefUseMap& def_use, Value& v, BasicBlock& u){
+			Value* variables[] = { &v };
+			demandDrivenDefUseAnalysis(def_use, variables, u);
 		}
 
+		// Walks the queries of several variables used in u together. A work item carries every
+		// variable whose walk reached its block with the same paths in progress: a variable drops out
+		// once its def is found, and an item splits where its variables' paths in progress differ. Each
+		// variable's Q and work items are exactly those of a walk of its own.
+		void demandDrivenDefUseAnalysis(DefUseMap& def_use, ArrayRef<Value*> variables, BasicBlock& u){
+			NumDefUseWalks += variables.size();
+			NamedRegionTimer timer("walk", "Query walks", "def-use", "Demand-driven def-use queries", TimePassesIsEnabled);
 
-		void demandDrivenDefUseAnalysis(map<string, set<pair<BasicBlock*, BasicBlock*>>>& def_use, Value& v, BasicBlock& u){
-			// Initialize Q map 
+			// Initialize Q map per variable
 			// Initialize worklist 
-		  queue<pair<BasicBlock*, set<pair<Query, QueryResolution>>>> worklist;
-			map<BasicBlock*, set<pair<Query, QueryResolution>>> Q;
+		  queue<WorkItem> worklist;
+			vector<map<BasicBlock*, IPPSet>> Q(variables.size());
 
 			// Initial q 
-			set<pair<Query, QueryResolution>> ipp;
+			IPPSet ipp;
+			BitVector live(variables.size(), true);
 			
 			// Iterate predecessor edgges .. raise q 
       for (BasicBlock* pred : predecessors(&u))
-				raise_query(def_use, v, make_pair(pred, &u), ipp, Q, worklist, u);
+				raise_query(def_use, variables, make_pair(pred, &u), ipp, live, Q, worklist, u);
 			
 
 			// Iterate worklist 
 			while(!worklist.empty()) {
-				pair<BasicBlock*, set<pair<Query, QueryResolution>>> workItem = worklist.front();
+				WorkItem workItem = std::move(worklist.front());
         worklist.pop();
+				++NumDefUseItems;
 
-				for (BasicBlock* pred : predecessors(workItem.first))
-					raise_query(def_use, v, make_pair(pred, workItem.first), workItem.second, Q, worklist, u);
+				for (BasicBlock* pred : predecessors(get<0>(workItem)))
+					raise_query(def_use, variables, make_pair(pred, get<0>(workItem)), get<1>(workItem), get<2>(workItem), Q, worklist, u);
 			}
 		}
 
 
-		void raise_query(map<string, set<pair<BasicBlock*, BasicBlock*>>>& def_use, Value& v,
-										 pair<BasicBlock*, BasicBlock*> e, set<pair<Query, QueryResolution>>& ipp,
-										 map<BasicBlock*, set<pair<Query, QueryResolution>>>& Q, 
-										 queue<pair<BasicBlock*, set<pair<Query, QueryResolution>>>>& worklist, 
+		void raise_query(DefUseMap& def_use, ArrayRef<Value*> variables,
+										 pair<BasicBlock*, BasicBlock*> e, IPPSet& ipp, const BitVector& live,
+										 vector<map<BasicBlock*, IPPSet>>& Q, 
+										 queue<WorkItem>& worklist, 
 										 BasicBlock& u){
 
+			if(!resolve(e, ipp))
+				return;
 
-			// Do we need to propagate? 
-			if(resolve(def_use, v, e, ipp, Q, u)){
-
-				
-				if(Q.count(e.first) == 0){
-
-					Q[e.first] = ipp;
-					worklist.push(make_pair(e.first, Q.at(e.first)));
-
-				}else{
-
-					set<pair<Query, QueryResolution>> temp = Q.at(e.first);
-					Q[e.first] = intersection_(Q.at(e.first), ipp);
-
-					if(temp != Q.at(e.first))
-						worklist.push(make_pair(e.first, Q.at(e.first)));
-
+			// Variables that go on past e, grouped by their paths in progress
+			map<IPPSet, BitVector> continuing;
+			for(unsigned i : live.set_bits()){
+				// Add to def-use and terminate if we found a def 
+				if(stores.getLastStore(e.first, variables[i]) != nullptr){
+					def_use.insert(variables[i], make_pair(e.first, &u));
+					continue;
 				}
 
+				// Do we need to propagate? 
+				map<BasicBlock*, IPPSet>::iterator q = Q[i].find(e.first);
+				if(q == Q[i].end())
+					q = Q[i].insert(make_pair(e.first, ipp)).first;
+				else if(!q->second.intersectWith(ipp))
+					continue;
+
+				BitVector& group = continuing[q->second];
+				group.resize(variables.size());
+				group.set(i);
 			}
+
+			for(map<IPPSet, BitVector>::iterator c = continuing.begin(); c != continuing.end(); ++c)
+				worklist.emplace(e.first, c->first, std::move(c->second));
 		}
 
 
-		bool resolve(map<string, set<pair<BasicBlock*, BasicBlock*>>>& def_use, Value& v,
-								 pair<BasicBlock*, BasicBlock*> e, set<pair<Query, QueryResolution>>& ipp,
-								 map<BasicBlock*, set<pair<Query, QueryResolution>>> &Q,
-								 BasicBlock& u){
-			
+		// Follows edge e with paths in progress ipp. Returns false if e is on an infeasible path.
+		bool resolve(pair<BasicBlock*, BasicBlock*> e, IPPSet& ipp){
+			++NumDefUseEdges;
+			const EdgeIPPSets& sets = getEdgeSets(e);
+
 			// Did we follow an infeasible path? 
-			if(intersection_(ipp, result.startSet[e]).size() != 0)
+			if(ipp.anyCommon(sets.startSet))
 				return false;
 
 			// Remove paths in progress that are no longer followed
-			ipp = intersection_(ipp, result.presentSet[e]);
+			ipp.intersectWith(sets.presentSet);
 
 			// Add paths in progress that are started at edge e
-			ipp = union_(ipp, result.endSet[e]);
+			ipp.unionWith(sets.endSet);
 
 			// Rename 
-			for (pair<Query, QueryResolution> p : ipp) {
-				ipp.erase(p);
-				ipp.insert(make_pair(detector.substitute((*e.first), p.first), p.second));
-			}
+			renamed.clear();
+			for (unsigned element : ipp.elements())
+				renamed.insert(detector.substitute((*e.first), IPPSet::queryOf(element)), IPPSet::resolutionOf(element));
+			ipp.swap(renamed);
 
-			// Add to def-use and terminate if we found a def 
-			for(BasicBlock::iterator i = e.first->begin(); i != e.first->end(); ++i)
-					if (i->getOpcode() == Instruction::Store)
-							if(i->getOperand(1)->getName() == v.getName()){
-								def_use[v.getName()].insert(make_pair(e.first, &u));
-								return false;
-							}
-			
 			return true;
 		}
 	
-		// Returns the intersection of two sets
-		set<pair<Query, QueryResolution>> intersection_(set<pair<Query, QueryResolution>>& s1,
-																									  set<pair<Query, QueryResolution>>& s2){
-			set<pair<Query, QueryResolution>> intersect; 
-			set_intersection(s1.begin(),s1.end(),s2.begin(),s2.end(),
-                  		inserter(intersect,intersect.begin()));
-			return intersect;
-		}
-
-		// Retruns the union of two sets 
-		set<pair<Query, QueryResolution>> union_(set<pair<Query, QueryResolution>>& s1,
-																						 set<pair<Query, QueryResolution>>& s2){
-			set<pair<Query, QueryResolution>> union_set; 
-			set_union(s1.begin(),s1.end(),s2.begin(),s2.end(),
-                  		inserter(union_set,union_set.begin()));
-			return union_set;
+		// Converts the detector's sets for an edge into bitsets the first time the edge is seen
+		const EdgeIPPSets& getEdgeSets(pair<BasicBlock*, BasicBlock*> e){
+			map<pair<BasicBlock*, BasicBlock*>, EdgeIPPSets>::iterator it = edgeSets.find(e);
+			if(it != edgeSets.end())
+				return it->second;
+
+			EdgeIPPSets& sets = edgeSets[e];
+			for(pair<QueryID, QueryResolution> p : result.startSet[e])
+				sets.startSet.insert(p.first, p.second);
+			for(pair<QueryID, QueryResolution> p : result.presentSet[e])
+				sets.presentSet.insert(p.first, p.second);
+			for(pair<QueryID, QueryResolution> p : result.endSet[e])
+				sets.endSet.insert(p.first, p.second);
+			return sets;
 		}
 	};
 
 }
 
+#undef DEBUG_TYPE
 
 #endif
@@ -0,0 +1,194 @@
+#ifndef DEMANDDRIVENDEFUSEANALYSIS_H_
+#define DEMANDDRIVENDEFUSEANALYSIS_H_
+
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "DemandDrivenDefUse.h"
+#include "ResultOutput.h"
+
+using namespace llvm;
+
+// New pass manager versions of the intraprocedural analyses. Both only read the function they run
+// on, so the function analysis manager caches them per function and an edit to one function only
+// drops that function's results.
+namespace {
+
+  // Infeasible paths of every conditional branch of a function.
+  struct FunctionInfeasiblePaths {
+    // Queries the sets refer to. Def-use queries add the queries they rename to.
+    std::unique_ptr<QueryInterner<Query>> queries;
+    std::map<BasicBlock*, InfeasiblePathResult> branchResults;
+
+    bool invalidate(Function& F, const PreservedAnalyses& PA, FunctionAnalysisManager::Invalidator& invalidator);
+  };
+
+  class InfeasiblePathAnalysis : public AnalysisInfoMixin<InfeasiblePathAnalysis> {
+  public:
+    typedef FunctionInfeasiblePaths Result;
+
+    Result run(Function& F, FunctionAnalysisManager&) {
+      return compute(F);
+    }
+
+    static Result compute(Function& F) {
+      Result paths;
+      paths.queries.reset(new QueryInterner<Query>());
+
+      std::vector<BasicBlock*> branchBlocks;
+      for (BasicBlock& B : F) {
+        branchBlocks.push_back(&B);
+      }
+      std::vector<InfeasiblePathResult> results;
+      InfeasiblePathDetector(*paths.queries).detectPaths(branchBlocks, results);
+      for (unsigned i = 0; i < branchBlocks.size(); ++i) {
+        std::swap(paths.branchResults[branchBlocks[i]], results[i]);
+      }
+      return paths;
+    }
+
+  private:
+    friend AnalysisInfoMixin<InfeasiblePathAnalysis>;
+    static AnalysisKey Key;
+  };
+
+  AnalysisKey InfeasiblePathAnalysis::Key;
+
+  // The sets depend on the instructions of the function, not only its CFG.
+  inline bool FunctionInfeasiblePaths::invalidate(Function& F, const PreservedAnalyses& PA, FunctionAnalysisManager::Invalidator& invalidator) {
+    PreservedAnalyses::PreservedAnalysisChecker checker = PA.getChecker<InfeasiblePathAnalysis>();
+    return !checker.preserved() && !checker.preservedSet<AllAnalysesOn<Function>>();
+  }
+
+  // Def-use pairs of a function.
+  struct FunctionDefUses {
+    DefUseMap defUses;
+
+    bool invalidate(Function& F, const PreservedAnalyses& PA, FunctionAnalysisManager::Invalidator& invalidator);
+  };
+
+  class DefUseAnalysis : public AnalysisInfoMixin<DefUseAnalysis> {
+  public:
+    typedef FunctionDefUses Result;
+
+    explicit DefUseAnalysis(bool batchVariables = true) : batchVariables(batchVariables) {}
+
+    Result run(Function& F, FunctionAnalysisManager& FAM) {
+      return compute(F, FAM.getResult<InfeasiblePathAnalysis>(F), batchVariables);
+    }
+
+    static Result compute(Function& F, FunctionInfeasiblePaths& paths, bool batchVariables) {
+      Result defUses;
+      DemandDrivenDefUse defUseAnalysis(F, *paths.queries, paths.branchResults, batchVariables);
+      for (BasicBlock& B : F) {
+        defUseAnalysis.startBlockAnalysis(B, defUses.defUses);
+      }
+      return defUses;
+    }
+
+  private:
+    friend AnalysisInfoMixin<DefUseAnalysis>;
+    static AnalysisKey Key;
+
+    bool batchVariables;
+  };
+
+  AnalysisKey DefUseAnalysis::Key;
+
+  // Also dropped along with the infeasible paths the pairs were found against.
+  inline bool FunctionDefUses::invalidate(Function& F, const PreservedAnalyses& PA, FunctionAnalysisManager::Invalidator& invalidator) {
+    PreservedAnalyses::PreservedAnalysisChecker checker = PA.getChecker<DefUseAnalysis>();
+    return (!checker.preserved() && !checker.preservedSet<AllAnalysesOn<Function>>()) ||
+           invalidator.invalidate<InfeasiblePathAnalysis>(F, PA);
+  }
+
+  inline void printDefUses(Function& F, const DefUseMap& defUses, raw_ostream& out) {
+    out << "[*] Performing def-use analysis on " << F.getName() << "\n";
+
+    for (unsigned variable : defUses.getVariablesByName()) {
+      out << "\t[$] Def-Use(" << defUses.getVariable(variable)->getName() << "): ";
+
+      for (std::pair<BasicBlock*, BasicBlock*> p : defUses.getDefUses(variable)) {
+        out << "(" << p.first->getName() << ", " << p.second->getName() << ") ";
+      }
+
+      out << "\n";
+    }
+
+    out << "\n";
+  }
+
+  // Writes the def-use pairs of a module's functions one function at a time, in the format given.
+  // Text is what printDefUses prints, and the summary is written by finish.
+  class FunctionDefUseWriter {
+  public:
+    FunctionDefUseWriter(Module& M, OutputFormat format, StringRef path) : writer(format, path) {
+      writer.begin(M, "def-use");
+    }
+
+    void write(Function& F, const DefUseMap& defUses) {
+      switch (writer.getFormat()) {
+      case OutputNone:
+        break;
+      case OutputSummary:
+        ++numberOfFunctions;
+        numberOfVariables += defUses.numberOfVariables();
+        for (unsigned variable = 0; variable < defUses.numberOfVariables(); ++variable) {
+          numberOfPairs += defUses.getDefUses(variable).size();
+        }
+        break;
+      case OutputText:
+        printDefUses(F, defUses, writer.stream());
+        break;
+      case OutputJSON:
+      case OutputBinary:
+        writeDefUses(writer, F, defUses);
+        break;
+      }
+    }
+
+    void finish() {
+      if (writer.getFormat() == OutputSummary) {
+        writer.stream() << "[*] Performed def-use analysis on " << numberOfFunctions << " functions, " << numberOfVariables << " variables\n";
+        writer.stream() << "[*] Total of " << numberOfPairs << " pairs were found. \n";
+      }
+    }
+
+  private:
+    ResultWriter writer;
+    // Totals for the summary output
+    unsigned numberOfFunctions = 0;
+    unsigned numberOfVariables = 0;
+    unsigned numberOfPairs = 0;
+  };
+
+  // Writes the def-use pairs of each function with a body, from the cached analyses if there are
+  // any. It runs on the module so that all functions go to one output.
+  class DefUsePrinterPass : public PassInfoMixin<DefUsePrinterPass> {
+  public:
+    DefUsePrinterPass(OutputFormat format, StringRef path) : format(format), path(path) {}
+
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+      FunctionAnalysisManager& FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+      FunctionDefUseWriter writer(M, format, path);
+      for (Function& F : M) {
+        if (!F.isDeclaration()) {
+          writer.write(F, FAM.getResult<DefUseAnalysis>(F).defUses);
+        }
+      }
+      writer.finish();
+      return PreservedAnalyses::all();
+    }
+
+  private:
+    OutputFormat format;
+    std::string path;
+  };
+
+}
+
+#endif
@@ -1,8 +1,19 @@
 
-#include "DemandDrivenDefUse.h"
+#include "DemandDrivenDefUseAnalysis.h"
+#include "ResultOutput.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
+static cl::opt<bool> IntraDDUBatchVariables("intra-ddu-batch-variables", cl::desc("Walk all variables loaded in a block together"), cl::init(true));
+static cl::opt<OutputFormat> IntraDDUOutput("intra-ddu-output", cl::desc("How the def-use pairs are written"), outputFormatValues(), cl::init(OutputText));
+static cl::opt<std::string> IntraDDUOutputFile("intra-ddu-output-file", cl::desc("File the def-use pairs are written to, - for stdout (default: stderr)"),
+                                               cl::value_desc("path"));
+
 namespace {
 
   class DemandDrivenDefUseRun: public FunctionPass {
@@ -10,29 +21,26 @@ namespace {
 
   public:
     static char ID;
+    std::unique_ptr<FunctionDefUseWriter> writer;
 
     DemandDrivenDefUseRun() : FunctionPass(ID) {}
 
-    bool runOnFunction(Function &F) override {
-			errs() << "[*] Performing def-use analysis on " << F.getName() << "\n";
-
-			map<string, set<pair<BasicBlock*, BasicBlock*>>>  def_use;
-			DemandDrivenDefUse defUseAnalysis; 
-
-			for(BasicBlock& B : F)
-				defUseAnalysis.startBlockAnalysis(B, def_use);
-
-			map<string, set<pair<BasicBlock*, BasicBlock*>>>::iterator it;
-			for (it = def_use.begin(); it != def_use.end(); ++it){
-					errs() << "\t[$] Def-Use(" << it->first << "): ";
+    bool doInitialization(Module &M) override {
+      writer.reset(new FunctionDefUseWriter(M, IntraDDUOutput, IntraDDUOutputFile));
+      return false;
+    }
 
-					for(pair<BasicBlock*, BasicBlock*> p : it->second)
-						errs() << "(" << p.first->getName() << ", " << p.second->getName() << ") ";
+    bool doFinalization(Module &M) override {
+      writer->finish();
+      writer.reset();
+      return false;
+    }
 
-					errs() << "\n"; 
-			}
+    bool runOnFunction(Function &F) override {
+			FunctionInfeasiblePaths paths = InfeasiblePathAnalysis::compute(F);
+			FunctionDefUses result = DefUseAnalysis::compute(F, paths, IntraDDUBatchVariables);
 
-			errs() << "\n";
+			writer->write(F, result.defUses);
 
       return false;
     }
@@ -47,3 +55,27 @@ namespace {
 char DemandDrivenDefUseRun::ID = 0;
 static RegisterPass<DemandDrivenDefUseRun> X("DemandDrivenDefUseRun", "Computes def-use pairs utilizing the infeasible paths information", true, true);
 
+#if LLVM_VERSION_MAJOR >= 7
+// New pass manager entry point, for opt -load-pass-plugin. Registers the analyses as
+// infeasible-paths and def-use, so passes can ask for them and require<> or invalidate<> work in
+// pipelines, and print<def-use> to print the cached pairs.
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return { LLVM_PLUGIN_API_VERSION, "DemandDrivenDefUse", LLVM_VERSION_STRING, [](PassBuilder& PB) {
+    PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager& FAM) {
+      FAM.registerPass([] { return InfeasiblePathAnalysis(); });
+      FAM.registerPass([] { return DefUseAnalysis(IntraDDUBatchVariables); });
+    });
+    PB.registerPipelineParsingCallback([](StringRef name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+      if (name == "print<def-use>") {
+        MPM.addPass(DefUsePrinterPass(IntraDDUOutput, IntraDDUOutputFile));
+        return true;
+      }
+      return false;
+    });
+    PB.registerPipelineParsingCallback([](StringRef name, FunctionPassManager& FPM, ArrayRef<PassBuilder::PipelineElement>) {
+      return parseAnalysisUtilityPasses<InfeasiblePathAnalysis>("infeasible-paths", name, FPM) ||
+             parseAnalysisUtilityPasses<DefUseAnalysis>("def-use", name, FPM);
+    });
+  }};
+}
+#endif
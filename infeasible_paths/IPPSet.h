@@ -0,0 +1,125 @@
+#ifndef IPPSET_H_
+#define IPPSET_H_
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/iterator_range.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "QueryInterner.h"
+
+using namespace llvm;
+
+// Set of infeasible paths in progress: (query, resolution) pairs stored as one bit per
+// 2 * QueryID + resolution. Only QueryTrue (0) and QueryFalse (1) are representable, which are the
+// only resolutions the detectors report in start/present/end sets. Intersection and union run a
+// word at a time over the underlying BitVector.
+class IPPSet {
+public:
+  IPPSet() {}
+
+  static unsigned elementFor(QueryID query, unsigned resolution) {
+    assert(resolution < 2 && "only true and false resolutions are tracked");
+    return query * 2 + resolution;
+  }
+
+  static QueryID queryOf(unsigned element) {
+    return element / 2;
+  }
+
+  static unsigned resolutionOf(unsigned element) {
+    return element % 2;
+  }
+
+  void insert(QueryID query, unsigned resolution) {
+    unsigned element = elementFor(query, resolution);
+    if (element >= bits.size()) {
+      bits.resize(std::max(element + 1, bits.size() * 2));
+    }
+    bits.set(element);
+  }
+
+  bool count(QueryID query, unsigned resolution) const {
+    unsigned element = elementFor(query, resolution);
+    return element < bits.size() && bits.test(element);
+  }
+
+  bool empty() const {
+    return bits.none();
+  }
+
+  unsigned size() const {
+    return bits.count();
+  }
+
+  // Clears every element but keeps the storage, so scratch sets can be reused without allocating.
+  void clear() {
+    bits.reset();
+  }
+
+  bool anyCommon(const IPPSet& other) const {
+    return bits.anyCommon(other.bits);
+  }
+
+  // Returns true if any element was removed.
+  bool intersectWith(const IPPSet& other) {
+    unsigned sizeBefore = bits.count();
+    bits &= other.bits;
+    return bits.count() != sizeBefore;
+  }
+
+  void unionWith(const IPPSet& other) {
+    bits |= other.bits;
+  }
+
+  void swap(IPPSet& other) {
+    std::swap(bits, other.bits);
+  }
+
+  iterator_range<BitVector::const_set_bits_iterator> elements() const {
+    return bits.set_bits();
+  }
+
+  // Sets compare by their elements, not their capacity.
+  bool operator==(const IPPSet& other) const {
+    int element = bits.find_first();
+    int otherElement = other.bits.find_first();
+    while (element != -1 && element == otherElement) {
+      element = bits.find_next(element);
+      otherElement = other.bits.find_next(otherElement);
+    }
+    return element == otherElement;
+  }
+
+  bool operator!=(const IPPSet& other) const {
+    return !(*this == other);
+  }
+
+  // Lexicographic over the sorted elements, matching std::set<std::pair<QueryID, QueryResolution>>.
+  bool operator<(const IPPSet& other) const {
+    int element = bits.find_first();
+    int otherElement = other.bits.find_first();
+    while (element != -1 && element == otherElement) {
+      element = bits.find_next(element);
+      otherElement = other.bits.find_next(otherElement);
+    }
+    if (element == otherElement || otherElement == -1) {
+      return false;
+    }
+    return element == -1 || element < otherElement;
+  }
+
+private:
+  BitVector bits;
+};
+
+// Start, present and end sets of one edge, converted once so the def-use traversal only does bitset
+// operations per visit.
+struct EdgeIPPSets {
+  IPPSet startSet;
+  IPPSet presentSet;
+  IPPSet endSet;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef INFEASIBLEPATHDETECTOR_H_
 #define INFEASIBLEPATHDETECTOR_H_
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/SmallPtrSet.h"
@@ -8,6 +10,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Support/raw_ostream.h"
@@ -17,10 +20,25 @@
 #include <queue>
 #include <map>
 #include <algorithm>
+
+#include "PropagationOrder.h"
+#include "QueryInterner.h"
+#include "TransferFunctionCache.h"
+
 using namespace llvm;
 
+#define DEBUG_TYPE "infeasible-paths"
+
 namespace {
 
+  STATISTIC(NumStepOneItems, "Visits taken off the step 1 worklist");
+  STATISTIC(NumVisits, "(block, query) pairs visited");
+  STATISTIC(NumResolvedTrue, "Queries resolved true");
+  STATISTIC(NumResolvedFalse, "Queries resolved false");
+  STATISTIC(NumResolvedUndefined, "Queries resolved undefined");
+  STATISTIC(NumStepTwoNodes, "Blocks taken off the step 2 worklist");
+  STATISTIC(NumStepTwoChanges, "Resolution sets grown in step 2");
+
 
   enum QueryOperator { 
     IsTrue, 
@@ -51,125 +69,258 @@ namespace {
     bool operator<(const Query& other) const {
       return (this->lhs < other.lhs) || (this->rhs == other.lhs && (this->queryOperator < other.queryOperator || (this->queryOperator == other.queryOperator && this->rhs < other.rhs)));
     }
+
+    QueryKey getKey() const {
+      QueryKey key = { lhs, queryOperator, rhs, false };
+      return key;
+    }
   };
 
   struct  InfeasiblePathResult {
-    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<Query, QueryResolution>>> startSet;
-    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<Query, QueryResolution>>> presentSet;
-    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<Query, QueryResolution>>> endSet;
+    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<QueryID, QueryResolution>>> startSet;
+    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<QueryID, QueryResolution>>> presentSet;
+    std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<QueryID, QueryResolution>>> endSet;
+
+    // Adds the sets of another result, e.g. of a branch detected in a batch.
+    void merge(const InfeasiblePathResult& other) {
+      mergeSets(startSet, other.startSet);
+      mergeSets(presentSet, other.presentSet);
+      mergeSets(endSet, other.endSet);
+    }
+
+  private:
+    static void mergeSets(std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<QueryID, QueryResolution>>>& s, const std::map<std::pair<BasicBlock*, BasicBlock*>, std::set<std::pair<QueryID, QueryResolution>>>& other) {
+      for (const auto& edge : other) {
+        s[edge.first].insert(edge.second.begin(), edge.second.end());
+      }
+    }
   };
 
   class InfeasiblePathDetector {
   private:
+    QueryInterner<Query>* queries;
+    TransferFunctionCache<BasicBlock*, QueryResolution> transferFunctions;
+    // Every (block, query) visit of the current batch, and the visits each one's propagation reached.
+    // A branch's own visits are the closure of its initial visit.
+    std::vector<std::pair<BasicBlock*, QueryID>> visits;
+    DenseMap<std::pair<BasicBlock*, QueryID>, unsigned> visitIds;
+    std::vector<std::vector<unsigned>> visitEdges;
 
   public:
-    InfeasiblePathDetector() {}
+    explicit InfeasiblePathDetector(QueryInterner<Query>& queries) : queries(&queries) {}
 
     void detectPaths(BasicBlock& basicBlock, InfeasiblePathResult& result) {
-      const TerminatorInst* terminator = basicBlock.getTerminator();
-      if (terminator->getNumSuccessors() == 1 || terminator->getOpcode() != Instruction::Br) {
-        return;
-      }
-
-      std::queue<std::pair<BasicBlock*, Query>> worklist;
-      std::map<BasicBlock*, std::vector<Query>> visited;
+      BasicBlock* branchBlocks[] = { &basicBlock };
+      std::vector<InfeasiblePathResult> results;
+      detectPaths(branchBlocks, results);
+      result.merge(results.front());
+    }
 
-      Query initialQuery;
-      initialQuery.lhs = terminator->getOperand(0);
-      initialQuery.rhs = nullptr;
-      initialQuery.queryOperator = IsTrue;
+    // Detects the infeasible paths of every branch in branchBlocks in one traversal. Steps 1 and 2 run
+    // once over the union of the branches' queries; step 3 runs per branch over the visits reachable
+    // from that branch's initial query. results[i] receives the sets of branchBlocks[i], and stays
+    // empty if it does not end in a conditional branch.
+    void detectPaths(ArrayRef<BasicBlock*> branchBlocks, std::vector<InfeasiblePathResult>& results) {
+      results.clear();
+      results.resize(branchBlocks.size());
+      visits.clear();
+      visitIds.clear();
+      visitEdges.clear();
+
+      std::queue<unsigned> worklist;
+      std::map<BasicBlock*, std::vector<QueryID>> visited;
+
+      std::vector<QueryID> initialQueries(branchBlocks.size());
+      std::vector<unsigned> initialVisits(branchBlocks.size());
+      std::vector<bool> isResolvedInstantly(branchBlocks.size(), false);
+      std::map<BasicBlock*, unsigned> branchOfBlock;
+      for (unsigned branch = 0; branch < branchBlocks.size(); ++branch) {
+        const TerminatorInst* terminator = branchBlocks[branch]->getTerminator();
+        if (terminator->getNumSuccessors() == 1 || terminator->getOpcode() != Instruction::Br) {
+          continue;
+        }
 
-      worklist.push(std::make_pair(&basicBlock, initialQuery));
-      visited[&basicBlock].push_back(initialQuery);
-      
-      BasicBlock* trueDestination = dyn_cast<BasicBlock>(terminator->getOperand(2));
-      BasicBlock* falseDestination = dyn_cast<BasicBlock>(terminator->getOperand(1));
+        Query branchQuery;
+        branchQuery.lhs = terminator->getOperand(0);
+        branchQuery.rhs = nullptr;
+        branchQuery.queryOperator = IsTrue;
+        initialQueries[branch] = queries->intern(branchQuery);
+        branchOfBlock[branchBlocks[branch]] = branch;
+
+        bool isNew;
+        initialVisits[branch] = getVisit(branchBlocks[branch], initialQueries[branch], visited, isNew);
+        if (isNew) {
+          worklist.push(initialVisits[branch]);
+        }
+      }
 
-      std::map<std::pair<Query, BasicBlock*>, std::set<QueryResolution>> queryResolutions;
-      std::set<std::pair<Query, BasicBlock*>> queriesResolvedInNode;
+      std::map<std::pair<QueryID, BasicBlock*>, std::set<QueryResolution>> queryResolutions;
+      std::set<std::pair<QueryID, BasicBlock*>> queriesResolvedInNode;
 
       QueryResolution resolution;
 
       // Step 1
-      while(worklist.size() != 0) {
-        std::pair<BasicBlock*, Query> workItem = worklist.front();
-        worklist.pop();
-
-        BasicBlock* b = workItem.first;
-        Query currentValue = workItem.second;
-
-        if(!resolve(*b, currentValue, resolution)) {
-          if (b == &(b->getParent()->getEntryBlock())) {
-            queriesResolvedInNode.insert(std::make_pair(currentValue, b));
-            queryResolutions[std::make_pair(currentValue, b)].insert(QueryUndefined);
-          }
+      {
+        NamedRegionTimer timer("step1", "Step 1", "infeasible-paths", "Infeasible path detection", TimePassesIsEnabled);
+        while(worklist.size() != 0) {
+          unsigned visit = worklist.front();
+          worklist.pop();
+          ++NumStepOneItems;
+
+          BasicBlock* b = visits[visit].first;
+          QueryID currentValue = visits[visit].second;
+
+          if(!resolve(*b, currentValue, resolution)) {
+            if (b == &(b->getParent()->getEntryBlock())) {
+              ++NumResolvedUndefined;
+              queriesResolvedInNode.insert(std::make_pair(currentValue, b));
+              queryResolutions[std::make_pair(currentValue, b)].insert(QueryUndefined);
+            }
 
-          currentValue = substitute(*b, currentValue);
-          for(BasicBlock* pred : predecessors(b)) {
-            if (std::find(visited[pred].begin(), visited[pred].end(), currentValue) == visited[pred].end()) {
-              visited[pred].push_back(currentValue);
-              worklist.push(std::make_pair(pred, currentValue));
+            currentValue = substitute(*b, currentValue);
+            for(BasicBlock* pred : predecessors(b)) {
+              bool isNew;
+              unsigned predVisit = getVisit(pred, currentValue, visited, isNew);
+              visitEdges[visit].push_back(predVisit);
+              if (isNew) {
+                worklist.push(predVisit);
+              }
             }
           }
-        }
-        else {
-          queriesResolvedInNode.insert(std::make_pair(currentValue, b));
-          queryResolutions[std::make_pair(currentValue, b)].insert(resolution);
-
-          // There is an edge case where the query may becomes resolved instantly. If this is case, just add the branch exit edges to all of the output sets.
-          if (b == &basicBlock && currentValue == initialQuery) {
+          else {
             if (resolution == QueryTrue) {
-              result.startSet[std::make_pair(&basicBlock, trueDestination)].insert( std::make_pair(initialQuery, QueryTrue));
-              result.presentSet[std::make_pair(&basicBlock, trueDestination)].insert(std::make_pair(initialQuery, QueryTrue));
-              result.endSet[std::make_pair(&basicBlock, trueDestination)].insert(std::make_pair(initialQuery, QueryTrue));
+              ++NumResolvedTrue;
             }
             else if (resolution == QueryFalse) {
-              result.startSet[std::make_pair(&basicBlock, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
-              result.presentSet[std::make_pair(&basicBlock, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
-              result.endSet[std::make_pair(&basicBlock, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
+              ++NumResolvedFalse;
+            }
+            else {
+              ++NumResolvedUndefined;
             }
-            return;
+            queriesResolvedInNode.insert(std::make_pair(currentValue, b));
+            queryResolutions[std::make_pair(currentValue, b)].insert(resolution);
+
+            // There is an edge case where the query may becomes resolved instantly. If this is case, just add the branch exit edges to all of the output sets.
+            std::map<BasicBlock*, unsigned>::iterator branchIter = branchOfBlock.find(b);
+            if (branchIter != branchOfBlock.end() && currentValue == initialQueries[branchIter->second]) {
+              unsigned branch = branchIter->second;
+              InfeasiblePathResult& result = results[branch];
+              QueryID initialQuery = currentValue;
+              BasicBlock* trueDestination = dyn_cast<BasicBlock>(b->getTerminator()->getOperand(2));
+              BasicBlock* falseDestination = dyn_cast<BasicBlock>(b->getTerminator()->getOperand(1));
+              if (resolution == QueryTrue) {
+                result.startSet[std::make_pair(b, trueDestination)].insert( std::make_pair(initialQuery, QueryTrue));
+                result.presentSet[std::make_pair(b, trueDestination)].insert(std::make_pair(initialQuery, QueryTrue));
+                result.endSet[std::make_pair(b, trueDestination)].insert(std::make_pair(initialQuery, QueryTrue));
+              }
+              else if (resolution == QueryFalse) {
+                result.startSet[std::make_pair(b, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
+                result.presentSet[std::make_pair(b, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
+                result.endSet[std::make_pair(b, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
+              }
+              isResolvedInstantly[branch] = true;
+            }
+          }
+        }
+      }
+
+      // Step 2
+      {
+        NamedRegionTimer timer("step2", "Step 2", "infeasible-paths", "Infeasible path detection", TimePassesIsEnabled);
+        executeStepTwo(visited, queryResolutions, queriesResolvedInNode);
+      }
+
+      // Step 3
+      NamedRegionTimer timer("step3", "Step 3", "infeasible-paths", "Infeasible path detection", TimePassesIsEnabled);
+      for (unsigned branch = 0; branch < branchBlocks.size(); ++branch) {
+        if (branchOfBlock.count(branchBlocks[branch]) != 0 && !isResolvedInstantly[branch]) {
+          executeStepThree(*branchBlocks[branch], initialQueries[branch], initialVisits[branch], queryResolutions, results[branch]);
+        }
+      }
+    }
+
+    // Propagates the resolutions found in step 1 forward to the visits that did not resolve their
+    // query, until no resolution set grows. Blocks come off the worklist by strongly connected
+    // component of the visited blocks, with reverse postorder inside each; the sets only grow by
+    // union, so the order changes how often a block is looked at but not what it ends up with.
+    void executeStepTwo(std::map<BasicBlock*, std::vector<QueryID>>& visited,
+                        std::map<std::pair<QueryID, BasicBlock*>, std::set<QueryResolution>>& queryResolutions,
+                        const std::set<std::pair<QueryID, BasicBlock*>>& queriesResolvedInNode) {
+      // Visited blocks, numbered in the order step 1 first reached them.
+      std::vector<BasicBlock*> blocks;
+      DenseMap<BasicBlock*, unsigned> indexOfBlock;
+      for (const std::pair<BasicBlock*, QueryID>& visit : visits) {
+        if (indexOfBlock.insert(std::make_pair(visit.first, (unsigned)blocks.size())).second) {
+          blocks.push_back(visit.first);
+        }
+      }
+      std::vector<std::vector<unsigned>> blockSuccessors(blocks.size());
+      for (unsigned index = 0; index < blocks.size(); ++index) {
+        for (BasicBlock* succ : successors(blocks[index])) {
+          DenseMap<BasicBlock*, unsigned>::iterator succIndex = indexOfBlock.find(succ);
+          if (succIndex != indexOfBlock.end()) {
+            blockSuccessors[index].push_back(succIndex->second);
           }
         }
       }
+      PropagationOrder order;
+      order.compute(blockSuccessors);
 
-      std::set<BasicBlock*> step2WorkList;
-      for (std::pair<const std::pair<Query, BasicBlock*>, std::set<QueryResolution>> resolvedNode : queryResolutions) {
+      // Ranks of the blocks waiting to be looked at. Blocks no query visited have nothing to propagate.
+      std::set<unsigned> step2WorkList;
+      for (std::pair<const std::pair<QueryID, BasicBlock*>, std::set<QueryResolution>> resolvedNode : queryResolutions) {
         BasicBlock* b = resolvedNode.first.second;
-        for (BasicBlock* succ : successors(b)) {
-          step2WorkList.insert(succ);
+        for (unsigned succ : blockSuccessors[indexOfBlock.lookup(b)]) {
+          step2WorkList.insert(order.getRank(succ));
         }
       }
 
-      // Step 2
       while (step2WorkList.size() != 0) {
-        std::set<BasicBlock*>::iterator bIter = step2WorkList.begin();
-        BasicBlock* b = *bIter;
+        std::set<unsigned>::iterator bIter = step2WorkList.begin();
+        unsigned index = order.getNode(*bIter);
+        BasicBlock* b = blocks[index];
         step2WorkList.erase(bIter);
+        ++NumStepTwoNodes;
 
-        for(Query query : visited[b]) {
+        bool changed = false;
+        for(QueryID query : visited[b]) {
 
-          std::pair<Query, BasicBlock*> currentBlockAndQuery = std::make_pair(query, b);
+          std::pair<QueryID, BasicBlock*> currentBlockAndQuery = std::make_pair(query, b);
           
           if (queriesResolvedInNode.count(currentBlockAndQuery) != 0) {
             continue;
           }
 
+          std::set<QueryResolution>& currentResolutions = queryResolutions[currentBlockAndQuery];
+          size_t currentNumberResultsForBlock = currentResolutions.size();
+          QueryID predQuery = substitute(*b, query);
           for (BasicBlock* pred : predecessors(b)) {
-            size_t currentNumberResultsForBlock = queryResolutions[currentBlockAndQuery].size();
-            for(QueryResolution qr : queryResolutions[std::make_pair(substitute(*b, query), pred)]) {
-              queryResolutions[currentBlockAndQuery].insert(qr);
-            }
-            if (queryResolutions[currentBlockAndQuery].size() > currentNumberResultsForBlock) {
-              for (BasicBlock* succ : successors(b)) {
-                step2WorkList.insert(succ);
-              }   
+            std::map<std::pair<QueryID, BasicBlock*>, std::set<QueryResolution>>::iterator predResolutions =
+              queryResolutions.find(std::make_pair(predQuery, pred));
+            if (predResolutions != queryResolutions.end()) {
+              currentResolutions.insert(predResolutions->second.begin(), predResolutions->second.end());
             }
           }
+          if (currentResolutions.size() > currentNumberResultsForBlock) {
+            ++NumStepTwoChanges;
+            changed = true;
+          }
+        }
+
+        // Successors only need another look if something they read from b changed.
+        if (changed) {
+          for (unsigned succ : blockSuccessors[index]) {
+            step2WorkList.insert(order.getRank(succ));
+          }
         }
       }
+    }
+
+    void executeStepThree(BasicBlock& basicBlock, QueryID initialQuery, unsigned initialVisit,
+                          std::map<std::pair<QueryID, BasicBlock*>, std::set<QueryResolution>>& queryResolutions, InfeasiblePathResult& result) {
+      BasicBlock* trueDestination = dyn_cast<BasicBlock>(basicBlock.getTerminator()->getOperand(2));
+      BasicBlock* falseDestination = dyn_cast<BasicBlock>(basicBlock.getTerminator()->getOperand(1));
 
-      // Step 3
       if (queryResolutions[std::make_pair(initialQuery, &basicBlock)].count(QueryTrue) > 0) {
         result.endSet[std::make_pair(&basicBlock, trueDestination)].insert(std::make_pair(initialQuery, QueryTrue));
       }
@@ -178,37 +329,85 @@ namespace {
         result.endSet[std::make_pair(&basicBlock, falseDestination)].insert(std::make_pair(initialQuery, QueryFalse));
       }
 
-      for (std::pair<BasicBlock*, std::vector<Query>> visitedNode : visited) {
-        BasicBlock* b = visitedNode.first;
-        for (Query query : visitedNode.second) {
-          Query substitutedQuery = substitute(*b, query);
-          for (BasicBlock* pred : predecessors(b)) {
-            if (queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryTrue) > 0) {
-              result.presentSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryTrue));
-            }
+      for (unsigned visit : getVisitsReachableFrom(initialVisit)) {
+        BasicBlock* b = visits[visit].first;
+        QueryID query = visits[visit].second;
+        QueryID substitutedQuery = substitute(*b, query);
+        for (BasicBlock* pred : predecessors(b)) {
+          if (queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryTrue) > 0) {
+            result.presentSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryTrue));
+          }
 
-            if (queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryFalse) > 0) {
-              result.presentSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryFalse));
-            }
+          if (queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryFalse) > 0) {
+            result.presentSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryFalse));
+          }
 
-            if (
-                  queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryTrue) > 0 
-                && queryResolutions[std::make_pair(substitutedQuery, pred)].size() == 1
-                && queryResolutions[std::make_pair(query, b)].size() > 1
-              ) {
-              result.startSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryTrue));
-            }
-            else if (
-                  queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryFalse) > 0 
-                && queryResolutions[std::make_pair(substitutedQuery, pred)].size() == 1
-                && queryResolutions[std::make_pair(query, b)].size() > 1
-              ) {
-              result.startSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryFalse));
-            }
+          if (
+                queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryTrue) > 0 
+              && queryResolutions[std::make_pair(substitutedQuery, pred)].size() == 1
+              && queryResolutions[std::make_pair(query, b)].size() > 1
+            ) {
+            result.startSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryTrue));
+          }
+          else if (
+                queryResolutions[std::make_pair(substitutedQuery, pred)].count(QueryFalse) > 0 
+              && queryResolutions[std::make_pair(substitutedQuery, pred)].size() == 1
+              && queryResolutions[std::make_pair(query, b)].size() > 1
+            ) {
+            result.startSet[std::make_pair(pred, b)].insert(std::make_pair(substitutedQuery, QueryFalse));
           }
         }
       }
+    }
 
+    // Returns the ID of the visit of query at b, creating it if query has not reached b yet.
+    unsigned getVisit(BasicBlock* b, QueryID query, std::map<BasicBlock*, std::vector<QueryID>>& visited, bool& isNew) {
+      std::pair<DenseMap<std::pair<BasicBlock*, QueryID>, unsigned>::iterator, bool> inserted =
+        visitIds.insert(std::make_pair(std::make_pair(b, query), (unsigned)visits.size()));
+      isNew = inserted.second;
+      if (isNew) {
+        ++NumVisits;
+        visited[b].push_back(query);
+        visits.push_back(std::make_pair(b, query));
+        visitEdges.push_back(std::vector<unsigned>());
+      }
+      return inserted.first->second;
+    }
+
+    std::vector<unsigned> getVisitsReachableFrom(unsigned initialVisit) {
+      std::vector<unsigned> reachable(1, initialVisit);
+      std::vector<bool> isReachable(visits.size(), false);
+      isReachable[initialVisit] = true;
+      for (unsigned i = 0; i < reachable.size(); ++i) {
+        for (unsigned next : visitEdges[reachable[i]]) {
+          if (!isReachable[next]) {
+            isReachable[next] = true;
+            reachable.push_back(next);
+          }
+        }
+      }
+      return reachable;
+    }
+
+    // Memoized resolve() of q in basicBlock.
+    bool resolve(BasicBlock& basicBlock, QueryID q, QueryResolution& resolution) {
+      TransferFunction<QueryResolution>& transfer = transferFunctions.get(&basicBlock, q);
+      if (!transfer.hasResolution) {
+        transfer.isResolved = resolve(basicBlock, queries->get(q), transfer.resolution);
+        transfer.hasResolution = true;
+      }
+      resolution = transfer.resolution;
+      return transfer.isResolved;
+    }
+
+    // Memoized substitute() of q through basicBlock.
+    QueryID substitute(BasicBlock& basicBlock, QueryID q) {
+      TransferFunction<QueryResolution>& transfer = transferFunctions.get(&basicBlock, q);
+      if (!transfer.hasSubstitution) {
+        transfer.substitutedQuery = queries->intern(substitute(basicBlock, queries->get(q)));
+        transfer.hasSubstitution = true;
+      }
+      return transfer.substitutedQuery;
     }
 
     Query substitute(BasicBlock& basicBlock, Query q) {
@@ -399,4 +598,6 @@ namespace {
   };
 }
 
-#endif
\ No newline at end of file
+#undef DEBUG_TYPE
+
+#endif
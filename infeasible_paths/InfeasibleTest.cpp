@@ -1,24 +1,130 @@
 //#include "InfeasiblePathDetector.h"
 #include "InterproceduralInfeasiblePathDetector.h"
+#include "ResultOutput.h"
+#include "WorkStealingPool.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <memory>
+
 using namespace llvm;
 
+static cl::opt<unsigned> IPDThreads("ipd-threads", cl::desc("Number of threads detecting the infeasible paths of a function's branches"), cl::init(1));
+static cl::opt<Step2Order> IPDStep2Order("ipd-step2-order", cl::desc("Order step 2 takes nodes off its worklist in"),
+                                         cl::values(clEnumValN(Step2LegacyOrder, "legacy", "By node ID"),
+                                                    clEnumValN(Step2ComponentOrder, "scc", "By strongly connected component, reverse postorder inside each")),
+                                         cl::init(Step2ComponentOrder));
+static cl::opt<OutputFormat> IPDOutput("ipd-output", cl::desc("How the infeasible paths of each branch are written"), outputFormatValues(),
+                                       cl::init(OutputText));
+static cl::opt<std::string> IPDOutputFile("ipd-output-file", cl::desc("File the infeasible paths are written to, - for stdout (default: stderr)"),
+                                          cl::value_desc("path"));
+static cl::opt<unsigned> IPDMaxSteps("ipd-max-steps", cl::desc("Step 1 work items each branch may take, 0 for no limit"), cl::init(0));
+static cl::opt<unsigned> IPDMaxVisits("ipd-max-visits", cl::desc("(node, query) visits each branch may make, 0 for no limit"), cl::init(0));
+static cl::opt<unsigned> IPDMaxCallDepth("ipd-max-call-depth", cl::desc("How deep step 1 may follow calls: 1 enters callees but not the functions they call, 0 for no limit"),
+                                         cl::init(0));
+static cl::opt<double> IPDMaxSeconds("ipd-max-seconds", cl::desc("Seconds step 1 may spend on each branch, 0 for no limit"), cl::init(0));
+
 namespace {
 
-  void printCallStack(std::stack<Node*> callStack) {
-    errs() << "(";
-    while(callStack.size() > 0) {
-      Node* n = callStack.top();
-      callStack.pop();
+  void printCallStack(CallContext callStack, const CallStringTrie& callStrings, raw_ostream& out) {
+    out << "(";
+    while(!callStrings.empty(callStack)) {
+      Node* n = callStrings.top(callStack);
+      callStack = callStrings.pop(callStack);
 
       if (n == nullptr) {
-        errs() << "null";
+        out << "null";
       }
       else {
-        errs()<< n->basicBlock->getName() << ", ";
+        out<< n->basicBlock->getName() << ", ";
       }
     }
 
-    errs() << ")";
+    out << ")";
+  }
+
+  void printSet(const std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>& set, const CallStringTrie& callStrings, raw_ostream& out) {
+    for (const auto& startingPoints : set) {
+      for (const std::tuple<QueryID, QueryResolution, CallContext>& startValue : startingPoints.second) {
+        if (std::get<1>(startValue) == QueryUndefined) {
+          out << "wtf?";
+        }
+        BasicBlock* bb1 = startingPoints.first.first->basicBlock;
+        BasicBlock* bb2 = startingPoints.first.second->basicBlock;
+        out<<"{e: " << bb1->getParent()->getName() << "." << bb1->getName() << ", " << bb2->getParent()->getName() << "." << bb2->getName() << " CS: ";
+        printCallStack(std::get<2>(startValue), callStrings, out);
+        out << " R: ";
+        if (std::get<1>(startValue) == QueryTrue) {
+          out << "T}";
+        }
+        else {
+          out << "F}";
+        }
+      }
+    }
+    out<< "\n";
+  }
+
+  unsigned countSet(const std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>& set) {
+    unsigned count = 0;
+    for (const auto& edge : set) {
+      count += edge.second.size();
+    }
+    return count;
+  }
+
+  // Writes a set as a JSON array of {"edge": [from, to], "callStack": [innermost call site, ...],
+  // "result": true or false}, or in binary as the number of elements followed by, for each, the
+  // edge's blocks, 1 or 0 for the result, the depth of the call stack and its call sites.
+  void writeSet(ResultWriter& writer, const std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>& set, const CallStringTrie& callStrings) {
+    raw_ostream& out = writer.stream();
+    bool json = writer.getFormat() == OutputJSON;
+    if (json) {
+      out << "[";
+    }
+    else {
+      encodeULEB128(countSet(set), out);
+    }
+
+    bool first = true;
+    for (const auto& edge : set) {
+      for (const std::tuple<QueryID, QueryResolution, CallContext>& value : edge.second) {
+        if (json) {
+          out << (first ? "{\"edge\":[" : ",{\"edge\":[");
+          first = false;
+        }
+        writer.writeBlock(edge.first.first->basicBlock);
+        if (json) {
+          out << ",";
+        }
+        writer.writeBlock(edge.first.second->basicBlock);
+        if (json) {
+          out << "],\"callStack\":[";
+        }
+        else {
+          encodeULEB128(std::get<1>(value) == QueryTrue ? 1 : 0, out);
+          unsigned depth = 0;
+          for (CallContext c = std::get<2>(value); !callStrings.empty(c); c = callStrings.pop(c)) {
+            ++depth;
+          }
+          encodeULEB128(depth, out);
+        }
+
+        for (CallContext c = std::get<2>(value); !callStrings.empty(c); c = callStrings.pop(c)) {
+          Node* callSite = callStrings.top(c);
+          if (json && c != std::get<2>(value)) {
+            out << ",";
+          }
+          writer.writeBlock(callSite == nullptr ? nullptr : callSite->basicBlock);
+        }
+        if (json) {
+          out << "],\"result\":" << (std::get<1>(value) == QueryTrue ? "true}" : "false}");
+        }
+      }
+    }
+    if (json) {
+      out << "]";
+    }
   }
 
   class InfeasibleTest : public FunctionPass {
@@ -26,96 +132,141 @@ namespace {
 
   public:
     static char ID;
-    Module* m;
+    std::unique_ptr<ICFG> graph;
+    // Kept for the whole module, so its threads are started once rather than for every function
+    std::unique_ptr<WorkStealingPool> pool;
+    // One per worker, since the query state is filled in lazily.
+    std::vector<std::unique_ptr<ModuleQueryState>> states;
+    std::unique_ptr<ResultWriter> writer;
+    DetectionBudget budget;
+    // Totals for the summary output
+    unsigned numberOfBranches = 0;
+    unsigned numberOfStartElements = 0;
+    unsigned numberOfPresentElements = 0;
+    unsigned numberOfEndElements = 0;
 
     InfeasibleTest() : FunctionPass(ID) {}
 
 
     bool doInitialization(Module &M) override {
-      m = &M;
+      graph.reset(new ICFG(M));
+      pool.reset(new WorkStealingPool(IPDThreads));
+      states.resize(pool->size());
+      for (std::unique_ptr<ModuleQueryState>& state : states) {
+        state.reset(new ModuleQueryState());
+      }
+      writer.reset(new ResultWriter(IPDOutput, IPDOutputFile));
+      writer->begin(M, "infeasible-paths");
+      budget.steps = IPDMaxSteps;
+      budget.visits = IPDMaxVisits;
+      budget.callDepth = IPDMaxCallDepth;
+      budget.seconds = IPDMaxSeconds;
+      return false;
+    }
+
+    bool doFinalization(Module &M) override {
+      graph.reset();
+      pool.reset();
+      states.clear();
+      if (writer->getFormat() == OutputSummary) {
+        writer->stream() << "[*] " << numberOfBranches << " branches with " << numberOfStartElements << " start, " << numberOfPresentElements
+                         << " present and " << numberOfEndElements << " end set elements\n";
+      }
+      writer.reset();
       return false;
     }
+
     bool runOnFunction(Function &F) override {
 
+      std::vector<Node*> branchNodes;
       for(BasicBlock& b : F) {
 
         const TerminatorInst* terminator = b.getTerminator();
         if (terminator->getNumSuccessors() == 1 || terminator->getOpcode() != Instruction::Br) {
           continue;
         }
-        
-        errs()<< "BasicBlock: " << F.getName() << "." << b.getName();
-        InfeasiblePathResult result;
-        InfeasiblePathDetector detector;
-        Node initialNode(&b, nullptr);
-        detector.detectPaths(initialNode, result, *m);
-
-        errs()<< " Start set: ";
-        for(std::pair< std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> startingPoints : result.startSet) {
-          for (std::tuple<Query, QueryResolution, std::stack<Node*>> startValue : startingPoints.second) {
-            if (std::get<1>(startValue) == QueryUndefined) {
-              errs() << "wtf?";
-            }
-            BasicBlock* bb1 = startingPoints.first.first->basicBlock;
-            BasicBlock* bb2 = startingPoints.first.second->basicBlock;
-            errs()<<"{e: " << bb1->getParent()->getName() << "." << bb1->getName() << ", " << bb2->getParent()->getName() << "." << bb2->getName() << " CS: ";
-            printCallStack(std::get<2>(startValue));
-            errs() << " R: ";
-            if (std::get<1>(startValue) == QueryTrue) {
-              errs() << "T}";
-            }
-            else {
-              errs() << "F}";
-            }
-          }
-          
+        branchNodes.push_back(graph->getNode(&b, nullptr));
+      }
+
+      // Branches are split into contiguous chunks, each detected branch by branch with one detector
+      // so its side tables are allocated once. With one thread the whole function is a single chunk;
+      // otherwise there are a few chunks per worker so idle workers have something to steal, and a
+      // function with fewer than two branches stays on this thread. The chunks only change which
+      // worker's caches a branch reuses, never its sets.
+      unsigned numberOfChunks = pool->size() == 1 ? 1 : std::min<unsigned>(branchNodes.size(), pool->size() * 4);
+      std::vector<InfeasiblePathResult> results(branchNodes.size());
+      // Call contexts are IDs into the trie of the worker that detected the branch.
+      std::vector<const CallStringTrie*> callStringsOfBranch(branchNodes.size());
+      std::vector<unsigned> exceededBudgets(numberOfChunks);
+      pool->run(numberOfChunks, [&](unsigned chunk, unsigned worker) {
+        unsigned begin = (unsigned long long)chunk * branchNodes.size() / numberOfChunks;
+        unsigned end = (unsigned long long)(chunk + 1) * branchNodes.size() / numberOfChunks;
+        InfeasiblePathDetector detector(*states[worker], IPDStep2Order);
+        detector.setTimePhases(TimePassesIsEnabled && pool->size() == 1);
+        detector.setBudget(budget);
+        for (unsigned branch = begin; branch < end; ++branch) {
+          detector.detectPaths(*branchNodes[branch], results[branch]);
+          exceededBudgets[chunk] |= detector.getExceededBudgets();
+          callStringsOfBranch[branch] = &states[worker]->callStrings;
         }
-        errs()<< "\n";
-
-        errs()<< "Present set: ";
-        for(std::pair< std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> startingPoints : result.presentSet) {
-          for (std::tuple<Query, QueryResolution, std::stack<Node*>> startValue : startingPoints.second) {
-            if (std::get<1>(startValue) == QueryUndefined) {
-              errs() << "wtf?";
-            }
-            BasicBlock* bb1 = startingPoints.first.first->basicBlock;
-            BasicBlock* bb2 = startingPoints.first.second->basicBlock;
-            errs()<<"{e: " << bb1->getParent()->getName() << "." << bb1->getName() << ", " << bb2->getParent()->getName() << "." << bb2->getName() << " CS: ";
-            printCallStack(std::get<2>(startValue));
-            errs() << " R: ";
-            if (std::get<1>(startValue) == QueryTrue) {
-              errs() << "T}";
-            }
-            else {
-              errs() << "F}";
-            }
-          }
-          
+      });
+
+      unsigned exceeded = 0;
+      for (unsigned chunkExceeded : exceededBudgets) {
+        exceeded |= chunkExceeded;
+      }
+      if (exceeded != 0) {
+        errs() << "[!] Detection in " << F.getName() << " ran out of budget (";
+        printExceededBudgets(exceeded, errs());
+        errs() << "), some of its queries were left undefined\n";
+      }
+
+      for (unsigned branch = 0; branch < branchNodes.size(); ++branch) {
+        BasicBlock& b = *branchNodes[branch]->basicBlock;
+        const InfeasiblePathResult& result = results[branch];
+        const CallStringTrie& callStrings = *callStringsOfBranch[branch];
+
+        switch (writer->getFormat()) {
+        case OutputNone:
+          break;
+        case OutputSummary:
+          ++numberOfBranches;
+          numberOfStartElements += countSet(result.startSet);
+          numberOfPresentElements += countSet(result.presentSet);
+          numberOfEndElements += countSet(result.endSet);
+          break;
+        case OutputText: {
+          raw_ostream& out = writer->stream();
+          out<< "BasicBlock: " << F.getName() << "." << b.getName();
+          out<< " Start set: ";
+          printSet(result.startSet, callStrings, out);
+          out<< "Present set: ";
+          printSet(result.presentSet, callStrings, out);
+          out<< "End set: ";
+          printSet(result.endSet, callStrings, out);
+          break;
         }
-        errs()<< "\n";
-
-        errs()<< "End set: ";
-        for(std::pair< std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> startingPoints : result.endSet) {
-          for (std::tuple<Query, QueryResolution, std::stack<Node*>> startValue : startingPoints.second) {
-            if (std::get<1>(startValue) == QueryUndefined) {
-              errs() << "wtf?";
-            }
-            BasicBlock* bb1 = startingPoints.first.first->basicBlock;
-            BasicBlock* bb2 = startingPoints.first.second->basicBlock;
-            errs()<<"{e: " << bb1->getParent()->getName() << "." << bb1->getName() << ", " << bb2->getParent()->getName() << "." << bb2->getName() << " CS: ";
-            printCallStack(std::get<2>(startValue));
-            errs() << " R: ";
-            if (std::get<1>(startValue) == QueryTrue) {
-              errs() << "T}";
-            }
-            else {
-              errs() << "F}";
-            }
-          }
-          
+        case OutputJSON: {
+          raw_ostream& out = writer->stream();
+          writer->beginRecord();
+          out << "{\"branch\":";
+          writer->writeBlock(&b);
+          out << ",\"start\":";
+          writeSet(*writer, result.startSet, callStrings);
+          out << ",\"present\":";
+          writeSet(*writer, result.presentSet, callStrings);
+          out << ",\"end\":";
+          writeSet(*writer, result.endSet, callStrings);
+          out << "}";
+          break;
+        }
+        case OutputBinary:
+          writer->writeBlock(&b);
+          writeSet(*writer, result.startSet, callStrings);
+          writeSet(*writer, result.presentSet, callStrings);
+          writeSet(*writer, result.endSet, callStrings);
+          break;
         }
-        errs()<< "\n";
-
       }
 
       return false;
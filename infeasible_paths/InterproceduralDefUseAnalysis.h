@@ -0,0 +1,353 @@
+#ifndef INTERPROCEDURALDEFUSEANALYSIS_H_
+#define INTERPROCEDURALDEFUSEANALYSIS_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "InterproceduralDemandDrivenDefUse.h"
+#include "ResultCache.h"
+#include "ResultOutput.h"
+#include "WorkStealingPool.h"
+
+using namespace llvm;
+
+// New pass manager versions of the interprocedural analyses. A branch's sets reach into its
+// callers and callees, and the ICFG holds instructions of every function, so both are module
+// analyses and an edit anywhere in the module drops them.
+namespace {
+
+  // Infeasible paths of every conditional branch in a module, with the ICFG, query states and
+  // store index the sets and the def-use queries over them refer to.
+  struct ModuleInfeasiblePathInfo {
+    std::unique_ptr<ICFG> graph;
+    // One per worker that detected paths; paths.stateOfFunction points into them.
+    std::vector<std::unique_ptr<ModuleQueryState>> states;
+    ModuleInfeasiblePaths paths;
+    // Last store to each variable in each node, so the queries never scan instructions
+    StoreIndex<unsigned> stores;
+    // Results of an earlier run, if a cache file was given
+    std::unique_ptr<ResultCache> cache;
+    std::string cachePath;
+    // ExceededBudget flags of the functions whose detection ran out of budget
+    DenseMap<Function*, unsigned> exceededBudgets;
+
+    bool invalidate(Module& M, const PreservedAnalyses& PA, ModuleAnalysisManager::Invalidator& invalidator);
+  };
+
+  class ModuleInfeasiblePathAnalysis : public AnalysisInfoMixin<ModuleInfeasiblePathAnalysis> {
+  public:
+    typedef ModuleInfeasiblePathInfo Result;
+
+    explicit ModuleInfeasiblePathAnalysis(unsigned numberOfThreads = 1, StringRef cachePath = StringRef(),
+                                          const DetectionBudget& budget = DetectionBudget())
+      : numberOfThreads(numberOfThreads), cachePath(cachePath), budget(budget) {}
+
+    Result run(Module& M, ModuleAnalysisManager&) {
+      return compute(M, numberOfThreads, cachePath, budget);
+    }
+
+    // The infeasible paths of every conditional branch, one task per function. The ICFG and the IR
+    // are only read, and each worker detects with its own query state, which it also fills with the
+    // renamings the def-use walks over its sets need. Functions of a lazily loaded
+    // module whose bodies were never read are left out. Functions whose entry in the
+    // cache file at cachePath is still valid are decoded instead of detected. The budget covers all
+    // the branches of a function together, and the sets of a function that runs out are not cached.
+    static Result compute(Module& M, unsigned numberOfThreads, StringRef cachePath = StringRef(),
+                          const DetectionBudget& budget = DetectionBudget()) {
+      Result info;
+      info.graph.reset(new ICFG(M));
+      if (!cachePath.empty()) {
+        info.cache.reset(new ResultCache(M, *info.graph));
+        info.cache->load(cachePath);
+        info.cachePath = cachePath.str();
+      }
+
+      std::vector<Function*> functions;
+      for (Function& F : M) {
+        if (!F.isMaterializable()) {
+          functions.push_back(&F);
+        }
+      }
+
+      WorkStealingPool pool(numberOfThreads);
+      info.states.resize(pool.size());
+      for (std::unique_ptr<ModuleQueryState>& state : info.states) {
+        state.reset(new ModuleQueryState());
+      }
+      std::vector<std::vector<Node*>> branchNodes(functions.size());
+      std::vector<std::vector<InfeasiblePathResult>> results(functions.size());
+      std::vector<ModuleQueryState*> stateOfFunction(functions.size());
+      std::vector<unsigned> exceededBudgets(functions.size());
+      pool.run(functions.size(), [&](unsigned task, unsigned worker) {
+        Function& F = *functions[task];
+        stateOfFunction[task] = info.states[worker].get();
+        InfeasiblePathDetector detector(*info.states[worker]);
+        if (!info.cache || !info.cache->lookupPaths(F, *info.states[worker], branchNodes[task], results[task])) {
+          for (BasicBlock& B : F) {
+            Node* n = info.graph->getNode(&B, nullptr);
+            if (n->endsWithConditionalBranch()) {
+              branchNodes[task].push_back(n);
+            }
+          }
+          detector.setTimePhases(TimePassesIsEnabled && pool.size() == 1);
+          detector.setFunctionBudget(budget);
+          results[task].resize(branchNodes[task].size());
+          SmallPtrSet<Function*, 8> touchedFunctions;
+          for (unsigned branch = 0; branch < branchNodes[task].size(); ++branch) {
+            detector.detectPaths(*branchNodes[task][branch], results[task][branch]);
+            exceededBudgets[task] |= detector.getExceededBudgets();
+            detector.getTouchedFunctions(touchedFunctions);
+          }
+          if (info.cache && exceededBudgets[task] == 0) {
+            info.cache->recordPaths(F, touchedFunctions, branchNodes[task], results[task], *info.states[worker]);
+          }
+        }
+
+        // Def-use walks over other workers' functions may share this state, so they only read it
+        for (const InfeasiblePathResult& result : results[task]) {
+          detector.substituteSetQueries(result);
+        }
+      });
+
+      for (unsigned i = 0; i < functions.size(); ++i) {
+        info.paths.stateOfFunction[functions[i]] = stateOfFunction[i];
+        if (exceededBudgets[i] != 0) {
+          info.exceededBudgets[functions[i]] = exceededBudgets[i];
+        }
+        for (unsigned j = 0; j < branchNodes[i].size(); ++j) {
+          std::swap(info.paths.branchResults[branchNodes[i][j]], results[i][j]);
+        }
+      }
+
+      for (unsigned id = 0; id < info.graph->size(); ++id) {
+        const std::vector<Instruction*>& instructions = info.graph->getNode(id)->getReversedInstructions();
+        for (std::vector<Instruction*>::const_reverse_iterator i = instructions.rbegin(); i != instructions.rend(); ++i) {
+          info.stores.add(id, *i);
+        }
+      }
+      return info;
+    }
+
+  private:
+    friend AnalysisInfoMixin<ModuleInfeasiblePathAnalysis>;
+    static AnalysisKey Key;
+
+    unsigned numberOfThreads;
+    std::string cachePath;
+    DetectionBudget budget;
+  };
+
+  AnalysisKey ModuleInfeasiblePathAnalysis::Key;
+
+  inline bool ModuleInfeasiblePathInfo::invalidate(Module& M, const PreservedAnalyses& PA, ModuleAnalysisManager::Invalidator& invalidator) {
+    PreservedAnalyses::PreservedAnalysisChecker checker = PA.getChecker<ModuleInfeasiblePathAnalysis>();
+    return !checker.preserved() && !checker.preservedSet<AllAnalysesOn<Module>>();
+  }
+
+  // Def-use pairs of every function in a module whose body was read, in module order.
+  struct ModuleDefUses {
+    std::vector<Function*> functions;
+    std::vector<DefUseMap> defUses;
+    DenseMap<Function*, unsigned> indexOfFunction;
+    // Walks of each function that ran out of budget
+    DenseMap<Function*, unsigned> fallbackWalks;
+
+    const DefUseMap& getDefUses(Function& F) const {
+      return defUses[indexOfFunction.lookup(&F)];
+    }
+
+    bool invalidate(Module& M, const PreservedAnalyses& PA, ModuleAnalysisManager::Invalidator& invalidator);
+  };
+
+  // Whether the walks of F's uses crossed the sets of a function whose detection ran out of budget.
+  inline bool readsApproximatePaths(const ModuleInfeasiblePathInfo& info, Function& F, const SmallPtrSetImpl<Function*>& enteredFunctions) {
+    if (info.exceededBudgets.count(&F) != 0) {
+      return true;
+    }
+    for (Function* entered : enteredFunctions) {
+      if (info.exceededBudgets.count(entered) != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  class ModuleDefUseAnalysis : public AnalysisInfoMixin<ModuleDefUseAnalysis> {
+  public:
+    typedef ModuleDefUses Result;
+
+    explicit ModuleDefUseAnalysis(unsigned numberOfThreads = 1, bool batchVariables = true, const WalkBudget& budget = WalkBudget())
+      : numberOfThreads(numberOfThreads), batchVariables(batchVariables), budget(budget) {}
+
+    Result run(Module& M, ModuleAnalysisManager& MAM) {
+      return compute(M, MAM.getResult<ModuleInfeasiblePathAnalysis>(M), numberOfThreads, batchVariables, budget);
+    }
+
+    // Def-use queries of every function, which only read the sets computed by
+    // ModuleInfeasiblePathAnalysis. Functions whose paths came from the cache take their pairs from
+    // it too, and the pairs of the others are recorded in it for saveResultCache. Pairs found by
+    // walks that ran out of budget are not recorded.
+    static Result compute(Module& M, const ModuleInfeasiblePathInfo& info, unsigned numberOfThreads, bool batchVariables,
+                          const WalkBudget& budget = WalkBudget()) {
+      Result result;
+      for (Function& F : M) {
+        if (!F.isMaterializable()) {
+          result.indexOfFunction[&F] = result.functions.size();
+          result.functions.push_back(&F);
+        }
+      }
+      result.defUses.resize(result.functions.size());
+      std::vector<unsigned> fallbackWalks(result.functions.size());
+
+      WorkStealingPool pool(numberOfThreads);
+      pool.run(result.functions.size(), [&](unsigned task, unsigned worker) {
+        Function& F = *result.functions[task];
+        if (info.cache && info.cache->lookupDefUses(F, result.defUses[task])) {
+          return;
+        }
+
+        InterproceduralDemandDrivenDefUse analysis(*info.graph, *info.paths.stateOfFunction.at(&F), info.paths.branchResults, info.stores,
+                                                   batchVariables);
+        analysis.timeWalks = TimePassesIsEnabled && pool.size() == 1;
+        analysis.budget = budget;
+        std::set<Value*> localVar;
+        for (BasicBlock& B : F) {
+          analysis.startBlockAnalysis(B, M, result.defUses[task], localVar);
+        }
+        fallbackWalks[task] = analysis.fallbackWalks;
+        if (info.cache && analysis.fallbackWalks == 0 && !readsApproximatePaths(info, F, analysis.enteredFunctions)) {
+          info.cache->recordDefUses(F, analysis.enteredFunctions, result.defUses[task]);
+        }
+      });
+
+      for (unsigned i = 0; i < result.functions.size(); ++i) {
+        if (fallbackWalks[i] != 0) {
+          result.fallbackWalks[result.functions[i]] = fallbackWalks[i];
+        }
+      }
+      return result;
+    }
+
+  private:
+    friend AnalysisInfoMixin<ModuleDefUseAnalysis>;
+    static AnalysisKey Key;
+
+    unsigned numberOfThreads;
+    bool batchVariables;
+    WalkBudget budget;
+  };
+
+  AnalysisKey ModuleDefUseAnalysis::Key;
+
+  // Also dropped along with the infeasible paths the pairs were found against.
+  inline bool ModuleDefUses::invalidate(Module& M, const PreservedAnalyses& PA, ModuleAnalysisManager::Invalidator& invalidator) {
+    PreservedAnalyses::PreservedAnalysisChecker checker = PA.getChecker<ModuleDefUseAnalysis>();
+    return (!checker.preserved() && !checker.preservedSet<AllAnalysesOn<Module>>()) ||
+           invalidator.invalidate<ModuleInfeasiblePathAnalysis>(M, PA);
+  }
+
+  inline void printDefUses(const ModuleDefUses& result, raw_ostream& out) {
+    int numberOfPairs = 0;
+    for (unsigned i = 0; i < result.functions.size(); ++i) {
+      out << "[*] Performing def-use analysis on " << result.functions[i]->getName() << "\n";
+
+      const DefUseMap& defUses = result.defUses[i];
+      for (unsigned variable : defUses.getVariablesByName()) {
+        out << "\t[$] Def-Use(" << defUses.getVariable(variable)->getName() << "): ";
+
+        for (std::pair<BasicBlock*, BasicBlock*> p : defUses.getDefUses(variable)) {
+          numberOfPairs++;
+          out << "(" << p.first->getParent()->getName() << ":" << p.first->getName() << ", " << p.second->getParent()->getName() << ":"
+              << p.second->getName() << ") ";
+        }
+        out << "\n";
+      }
+    }
+
+    out << "[*] Total of " << numberOfPairs << " pairs were found. \n";
+  }
+
+  // Rewrites the cache file, if one was given, with the results the analyses recorded. The analyses
+  // themselves never write it, so recomputing them after an invalidation does no file I/O.
+  inline void saveResultCache(const ModuleInfeasiblePathInfo& info, raw_ostream& out) {
+    if (info.cache && !info.cache->save(info.cachePath)) {
+      out << "[!] Could not write the result cache to " << info.cachePath << "\n";
+    }
+  }
+
+  // Names the functions whose results are approximate because the analysis ran out of budget.
+  inline void printBudgetFallbacks(const ModuleInfeasiblePathInfo& info, const ModuleDefUses& result, raw_ostream& out) {
+    for (Function* F : result.functions) {
+      unsigned exceeded = info.exceededBudgets.lookup(F);
+      if (exceeded != 0) {
+        out << "[!] Detection in " << F->getName() << " ran out of budget (";
+        printExceededBudgets(exceeded, out);
+        out << "), some of its queries were left undefined\n";
+      }
+      unsigned walks = result.fallbackWalks.lookup(F);
+      if (walks != 0) {
+        out << "[!] " << walks << " def-use walks in " << F->getName() << " ran out of budget and ignored infeasible paths\n";
+      }
+    }
+  }
+
+  // Writes the pairs in the writer's format. Text is what printDefUses prints.
+  inline void writeDefUses(ResultWriter& writer, Module& M, const ModuleDefUses& result) {
+    switch (writer.getFormat()) {
+    case OutputNone:
+      break;
+    case OutputSummary: {
+      unsigned numberOfVariables = 0;
+      unsigned numberOfPairs = 0;
+      for (const DefUseMap& defUses : result.defUses) {
+        numberOfVariables += defUses.numberOfVariables();
+        for (unsigned variable = 0; variable < defUses.numberOfVariables(); ++variable) {
+          numberOfPairs += defUses.getDefUses(variable).size();
+        }
+      }
+      writer.stream() << "[*] Performed def-use analysis on " << result.functions.size() << " functions, " << numberOfVariables << " variables\n";
+      writer.stream() << "[*] Total of " << numberOfPairs << " pairs were found. \n";
+      break;
+    }
+    case OutputText:
+      printDefUses(result, writer.stream());
+      break;
+    case OutputJSON:
+    case OutputBinary:
+      writer.begin(M, "def-use");
+      for (unsigned i = 0; i < result.functions.size(); ++i) {
+        writeDefUses(writer, *result.functions[i], result.defUses[i]);
+      }
+      break;
+    }
+  }
+
+  // Writes the def-use pairs of the module in the format given, from the cached analysis if there
+  // is one.
+  class ModuleDefUsePrinterPass : public PassInfoMixin<ModuleDefUsePrinterPass> {
+  public:
+    ModuleDefUsePrinterPass(OutputFormat format, StringRef path) : format(format), path(path) {}
+
+    PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+      const ModuleDefUses& defUses = MAM.getResult<ModuleDefUseAnalysis>(M);
+      const ModuleInfeasiblePathInfo& info = MAM.getResult<ModuleInfeasiblePathAnalysis>(M);
+      saveResultCache(info, errs());
+      printBudgetFallbacks(info, defUses, errs());
+      ResultWriter writer(format, path);
+      writeDefUses(writer, M, defUses);
+      return PreservedAnalyses::all();
+    }
+
+  private:
+    OutputFormat format;
+    std::string path;
+  };
+
+}
+
+#endif
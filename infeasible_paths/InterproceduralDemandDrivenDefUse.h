@@ -2,29 +2,58 @@
 #define INTERPROCEDURALDEMANDDRIVENDEFUSE_H_
 
 #include "InterproceduralInfeasiblePathDetector.h"
+#include "IPPSet.h"
+#include "DefUseMap.h"
+#include "StoreIndex.h"
 
 using namespace llvm;
 using namespace std;
 
+#define DEBUG_TYPE "def-use"
+
 namespace{
 
+	STATISTIC(NumDefUseWalks, "Def-use queries walked");
+	STATISTIC(NumDefUseItems, "Work items taken off the def-use worklists");
+	STATISTIC(NumDefUseEdges, "Edges followed by def-use walks");
+	STATISTIC(NumDefUseFallbacks, "Def-use walks that ran out of budget");
+
+	// Start/present/end sets of every conditional branch in a module, computed once before any def-use
+	// query reads them. The query IDs and calling contexts in a function's sets refer to the state it
+	// was detected with.
+	struct ModuleInfeasiblePaths {
+		map<Node*, InfeasiblePathResult> branchResults;
+		map<Function*, ModuleQueryState*> stateOfFunction;
+	};
+
+	// Limits on a single def-use walk, 0 meaning no limit: work items taken off its worklist and wall
+	// time. A walk that runs out starts over as a plain reaching-definitions search that ignores the
+	// infeasible paths and calling contexts, which finds every pair the walk would have and maybe more.
+	struct WalkBudget {
+		WalkBudget() : steps(0), seconds(0) {}
+
+		unsigned steps;
+		double seconds;
+	};
+
   class InterproceduralDemandDrivenDefUse { 
   private:
 
   public:
 
-		InfeasiblePathResult result;
-		InfeasiblePathDetector detector;
+		// Infeasible paths of the branch at the current use, or none if the use is not at a branch
+		const InfeasiblePathResult *result;
+		InfeasiblePathResult noInfeasiblePaths;
 
 		// Pointer to the def-use map we are adding to
-		map<string, set<pair<BasicBlock*, BasicBlock*>>> *def_use;
+		DefUseMap *def_use;
 
 		// IPP
-		typedef set<pair<Query, QueryResolution>> IPP;
+		typedef IPPSet IPP;
 
 		// Summery node has: 
 		// 1) def-uses 2) is it transp? 3)ipp_
-		typedef tuple<map<string, set<pair<BasicBlock*, BasicBlock*>>>, bool, IPP> SN;
+		typedef tuple<DefUseMap, bool, IPP> SN;
 		
 		// Def-Use query type
 		// Last element: True = summery node query 
@@ -39,27 +68,83 @@ namespace{
 		// Node-DefUseQuery Map
 		map<Node*, DUQuery> Q;
 		
-		// Keeping a stack of entered call sites 
-		stack<Node*> key; 
+		// Calling context of the entered call sites 
+		CallContext key; 
 
 		// Module 
 		Module *m; 
 
-    InterproceduralDemandDrivenDefUse() {}
+		// Interprocedural CFG shared by every use in the module
+		ICFG *graph;
+
+		// Calling contexts of the entered call sites. The walks keep their own rather than add to the
+		// state, which walks on other threads may be reading.
+		CallStringTrie callStrings;
+
+		// Calling contexts the sets refer to
+		const CallStringTrie *setCallStrings;
+
+		// Transfer functions of the state the sets were detected with, which already hold the
+		// substitution of every query in the sets
+		const TransferFunctionCache<unsigned, QueryResolution> *transferFunctions;
+
+		// Start/present/end sets of the edges seen so far under result, per calling context
+		map<tuple<Node*, Node*, CallContext>, EdgeIPPSets> edgeSets;
+
+		// Scratch set for renaming, reused across edges
+		IPP renamed;
+
+		// Infeasible paths of the conditional branches, computed before any use is analyzed
+		const map<Node*, InfeasiblePathResult> *branchResults;
+
+		// Last store to each variable in each node of the ICFG
+		const StoreIndex<unsigned> *stores;
+
+		// Walk the local variables loaded at the same node together instead of one at a time
+		bool batchVariables;
+
+		// Node, paths in progress, and the local variables whose walks reached the node with them
+		typedef tuple<Node*, IPP, BitVector> LocalWorkItem;
+
+		// Functions other than the one analyzed that the walks crossed into
+		SmallPtrSet<Function*, 8> enteredFunctions;
+
+		// The walk timer is shared by every instance, so instances running on several threads at once
+		// must turn it off
+		bool timeWalks;
+
+		WalkBudget budget;
 
-		void startBlockAnalysis(BasicBlock& B, Module &m, map<string, set<pair<BasicBlock*, BasicBlock*>>>& def_use, set<string>& localVar){		
+		// Walks of this instance that ran out of budget
+		unsigned fallbackWalks;
+
+    // state must be the one the sets were detected with, after InfeasiblePathDetector::substituteSetQueries
+    // has run over them.
+    InterproceduralDemandDrivenDefUse(ICFG& graph, const ModuleQueryState& state, const map<Node*, InfeasiblePathResult>& branchResults,
+                                      const StoreIndex<unsigned>& stores, bool batchVariables)
+      : result(&noInfeasiblePaths), key(EmptyContext), graph(&graph), setCallStrings(&state.callStrings),
+        transferFunctions(&state.transferFunctions), branchResults(&branchResults), stores(&stores), batchVariables(batchVariables),
+        timeWalks(TimePassesIsEnabled), fallbackWalks(0) {}
+
+		void startBlockAnalysis(BasicBlock& B, Module &m, DefUseMap& def_use, set<Value*>& localVar){		
 			this->def_use = &def_use; 
 			this->m = &m;
+			// Every block starts outside of any call
+			key = EmptyContext;
 
 			set<Value*> local_def; 
 
+			// Local variables waiting to be walked together from localNode
+			vector<Value*> localVariables;
+			Node* localNode = nullptr;
+
 			// Iterate over used variables, call demand driven analysis on each 
 			for(BasicBlock::iterator ins = B.begin(); ins != B.end(); ++ins){
 					// Did we find an allocate instruction? Means that the scope of this 
 					// variable is limited to the function only... Do intraprocedural 
 					// def-use analysis only. 
 					if ((*ins).getOpcode() == Instruction::Alloca)
-						localVar.insert(ins->getName());
+						localVar.insert(&*ins);
 					if ((*ins).getOpcode() == Instruction::Store){
             Value* op = ins->getOperand(1);
 						if(op->hasName())
@@ -67,20 +152,52 @@ namespace{
 					}		
 					else if ((*ins).getOpcode() == Instruction::Load){
             Value* op = ins->getOperand(0);
-						bool isLocal = localVar.find(op->getName()) != localVar.end();
+						bool isLocal = localVar.find(op) != localVar.end();
 						if(op->hasName()){
 							if(local_def.find(op) != local_def.end() && isLocal)
-								def_use[op->getName()].insert(make_pair(&B, &B));
-							else
-								demandDrivenDefUseAnalysis(*op, Node(&B, &(*ins)), isLocal);
+								def_use.insert(op, make_pair(&B, &B));
+							else{
+								Node* u = graph->getNodeFor(&B, &(*ins));
+								if(batchVariables && isLocal){
+									if(u != localNode){
+										flushLocalQueries(localVariables, localNode);
+										localNode = u;
+									}
+									if(find(localVariables.begin(), localVariables.end(), op) == localVariables.end())
+										localVariables.push_back(op);
+								}else{
+									// Walks of global variables move key, which the waiting local walks start from
+									flushLocalQueries(localVariables, localNode);
+									demandDrivenDefUseAnalysis(*op, *u, isLocal);
+								}
+							}
 						}
 					}		
 			
 			}
+			flushLocalQueries(localVariables, localNode);
     }
 
-		void demandDrivenDefUseAnalysis(Value& v, Node u, bool isLocal){
-			detector.detectPaths(u, result, *m);
+		void flushLocalQueries(vector<Value*>& localVariables, Node* u){
+			if(localVariables.empty())
+				return;
+			demandDrivenLocalDefUseAnalysis(localVariables, *u);
+			localVariables.clear();
+		}
+
+		void useResultOf(Node& u){
+			map<Node*, InfeasiblePathResult>::const_iterator branchResult = branchResults->find(&u);
+			const InfeasiblePathResult *useResult = branchResult != branchResults->end() ? &branchResult->second : &noInfeasiblePaths;
+			if (useResult != result){
+				result = useResult;
+				edgeSets.clear();
+			}
+		}
+
+		void demandDrivenDefUseAnalysis(Value& v, Node& u, bool isLocal){
+			++NumDefUseWalks;
+			NamedRegionTimer timer("walk", "Query walks", "def-use", "Demand-driven def-use queries", timeWalks);
+			useResultOf(u);
 
 		  worklist = queue<pair<Node*, DUQuery>>();
 			Q = map<Node*, DUQuery>(); 
@@ -95,24 +212,33 @@ namespace{
 			
 
 			// Iterate worklist 
+			CallContext startKey = key;
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			unsigned steps = 0;
 			while(!worklist.empty()) {
-				pair<Node*, DUQuery> workItem = worklist.front();
+				if(exceedsBudget(++steps, start)){
+					key = startKey;
+					findReachingDefs(v, u, isLocal);
+					break;
+				}
+				pair<Node*, DUQuery> workItem = std::move(worklist.front());
         worklist.pop();
+				++NumDefUseItems;
 				
 				// Case n is call site node
 				if(isCallSite(workItem.first) && !isLocal){
 					// Keeping track of call sites
-					key.push(workItem.first); 
+					key = callStrings.push(key, workItem.first); 
 					
 					for(Node* x : workItem.first->getPredecessors()){
 					
 						if(SNMap.count(make_tuple(x, &v, get<0>(workItem.second))) == 0){
-							SN s = make_tuple(map<string, set<pair<BasicBlock*, BasicBlock*>>>() , false, IPP());
+							SN s = make_tuple(DefUseMap(), false, IPP());
 							DUQuery q_ = make_tuple(get<0>(workItem.second), s, true);
 							raise_query(v, make_pair(x, workItem.first), q_, u, isLocal);
 						}else{
 
-							add_to_def_use(get<0>(SNMap.at(make_tuple(x, &v, get<0>(workItem.second)))), v.getName());
+							add_to_def_use(get<0>(SNMap.at(make_tuple(x, &v, get<0>(workItem.second)))), v);
 
 							if(get<1>(SNMap.at(make_tuple(x, &v, get<0>(workItem.second))))){
 								for (Node* pred : workItem.first->getPredecessors()){
@@ -124,8 +250,8 @@ namespace{
 					}
 
 				}else if(workItem.first->isEntryOfFunction  && !isLocal){
-					if(!key.empty())
-						key.pop(); 
+					if(!callStrings.empty(key))
+						key = callStrings.pop(key); 
 					
 					if (get<2>(workItem.second)){
 						get<1>(get<1>(workItem.second)) = true;
@@ -155,10 +281,7 @@ namespace{
 
 				}else{
 
-					DUQuery temp = Q.at(e.first);
-					get<0>(Q[e.first]) = intersection_(get<0>(Q.at(e.first)), get<0>(q));
-
-					if(get<0>(temp) != get<0>(Q.at(e.first)))
+					if(get<0>(Q[e.first]).intersectWith(get<0>(q)))
 						worklist.push(make_pair(e.first, Q.at(e.first)));
 
 				}
@@ -168,81 +291,187 @@ namespace{
 
 
 		bool resolve(Value& v, pair<Node*, Node*> e, DUQuery &q, Node& u, bool isLocal){
+			if(!followEdge(e, get<0>(q)))
+				return false;
+
+			// Add to def-use and terminate if we found a def 
+			if(stores->getLastStore(e.first->id, &v) != nullptr){
+				if(isLocal && (e.first->basicBlock->getParent() != u.basicBlock->getParent()))
+					return true;
+				pair<BasicBlock*, BasicBlock*> defUse = make_pair(e.first->basicBlock, u.basicBlock);
+				def_use->insert(&v, defUse);
+				
+				// Is it a summery node query?									
+				if(get<2>(q) && !isLocal){
+					SN s = get<1>(q);
+					get<0>(s).insert(&v, defUse);
+				}
+
+				return false;
+			}
+
+			return true;
+		}
+
+		// Follows edge e with paths in progress ipp. Returns false if e is on an infeasible path.
+		bool followEdge(pair<Node*, Node*> e, IPP& ipp){
 			if(e.first == nullptr)
 				return false;
+			++NumDefUseEdges;
+
+			if(e.first->basicBlock->getParent() != e.second->basicBlock->getParent())
+				enteredFunctions.insert(e.first->basicBlock->getParent());
 
 			// Did we follow an infeasible path? 
-			tuple<Node*, Node*, stack<Node*>> resultKey = make_tuple(e.first, e.second, key);
-			IPP startSet = result.getStartSetFor(resultKey);
-			if(intersection_(get<0>(q), startSet).size() != 0) 
+			tuple<Node*, Node*, CallContext> resultKey = make_tuple(e.first, e.second, key);
+			const EdgeIPPSets& sets = getEdgeSets(resultKey);
+			if(ipp.anyCommon(sets.startSet)) 
 				return false;
 
 			// Remove paths in progress that are no longer followed
-			IPP presentSet = result.getPresentSetFor(resultKey);
-			get<0>(q) = intersection_(get<0>(q), presentSet);
+			ipp.intersectWith(sets.presentSet);
 
 			// Add paths in progress that are started at edge e
-			IPP endSet = result.getEndSetFor(resultKey);
-			get<0>(q) = union_(get<0>(q), endSet);
+			ipp.unionWith(sets.endSet);
 
 
 			// Rename 
-			for (pair<Query, QueryResolution> p : get<0>(q)) {
-				get<0>(q).erase(p);
-				std::map<Node*, Query> dummy; 
-				Query newQuery = detector.substitute(*e.first, p.first, dummy);
-				get<0>(q).insert(make_pair(newQuery, p.second));
-			}
+			renamed.clear();
+			for (unsigned element : ipp.elements())
+				renamed.insert(substitute(*e.first, IPPSet::queryOf(element)), IPPSet::resolutionOf(element));
+			ipp.swap(renamed);
+			return true;
+		}
 
-			// Add to def-use and terminate if we found a def 
-			auto instructions =  e.first->getReversedInstructions();
+		// Walks the queries of several local variables used at u together. Local walks never push or
+		// pop calling contexts and carry no summary node, so their work items reduce to the paths in
+		// progress; an item carries every variable whose walk reached its node with the same ones, and
+		// splits where they differ. Each variable's Q and work items are exactly those of a walk of its
+		// own.
+		void demandDrivenLocalDefUseAnalysis(ArrayRef<Value*> variables, Node& u){
+			NumDefUseWalks += variables.size();
+			NamedRegionTimer timer("walk", "Query walks", "def-use", "Demand-driven def-use queries", timeWalks);
+			useResultOf(u);
+
+			queue<LocalWorkItem> localWorklist;
+			vector<map<Node*, IPP>> localQ(variables.size());
+
+			// Initial q 
+			IPP ipp;
+			BitVector live(variables.size(), true);
+
+			// Iterate predecessor edgges .. raise q 
+      for (Node* pred : u.getPredecessors())
+				raise_local_query(variables, make_pair(pred, &u), ipp, live, localQ, localWorklist, u);
 
-			if(e.first->getReversedInstructions().empty())
+			// Iterate worklist 
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			unsigned steps = 0;
+			while(!localWorklist.empty()) {
+				if(exceedsBudget(++steps, start)){
+					for(Value* v : variables)
+						findReachingDefs(*v, u, true);
+					break;
+				}
+				LocalWorkItem workItem = std::move(localWorklist.front());
+        localWorklist.pop();
+				++NumDefUseItems;
+
+				for (Node* pred : get<0>(workItem)->getPredecessors())
+					raise_local_query(variables, make_pair(pred, get<0>(workItem)), get<1>(workItem), get<2>(workItem), localQ, localWorklist, u);
+			}
+		}
+
+		// True once a walk has taken steps work items. The clock is only read every 256 items.
+		bool exceedsBudget(unsigned steps, chrono::steady_clock::time_point start){
+			if(budget.steps != 0 && steps > budget.steps)
 				return true;
+			return budget.seconds != 0 && steps % 256 == 0 &&
+				chrono::duration<double>(chrono::steady_clock::now() - start).count() > budget.seconds;
+		}
 
-			for(vector<Instruction*>::reverse_iterator i = instructions.rbegin(); i != instructions.rend(); ++i)
-					if ((*i)->getOpcode() == Instruction::Store)
-							if((*i)->getOperand(1)->getName() == v.getName()){
-								if(isLocal && (e.first->basicBlock->getParent() != u.basicBlock->getParent()))
-									continue;
-								pair<BasicBlock*, BasicBlock*> defUse = make_pair(e.first->basicBlock, u.basicBlock);
-								(*def_use)[v.getName()].insert(defUse);
-								
-								// Is it a summery node query?									
-								if(get<2>(q) && !isLocal){
-									SN s = get<1>(q);
-									get<0>(s)[v.getName()].insert(defUse);
-								}
+		// Pairs u with every def of v reachable backwards from it along the ICFG, stopping at the first
+		// def on each path. Every path a walk follows is one of these, so it finds a superset of the
+		// walk's pairs. Local variables only take defs in u's function, as the walks do.
+		void findReachingDefs(Value& v, Node& u, bool isLocal){
+			++NumDefUseFallbacks;
+			++fallbackWalks;
+			vector<Node*> stack(u.getPredecessors().begin(), u.getPredecessors().end());
+			DenseSet<Node*> seen;
+			while(!stack.empty()){
+				Node* n = stack.back();
+				stack.pop_back();
+				if(n == nullptr || !seen.insert(n).second)
+					continue;
+				if(stores->getLastStore(n->id, &v) != nullptr && (!isLocal || n->basicBlock->getParent() == u.basicBlock->getParent())){
+					def_use->insert(&v, make_pair(n->basicBlock, u.basicBlock));
+					continue;
+				}
+				for(Node* pred : n->getPredecessors())
+					stack.push_back(pred);
+			}
+		}
 
-								return false;
-							}
+		void raise_local_query(ArrayRef<Value*> variables, pair<Node*, Node*> e, IPP& ipp, const BitVector& live,
+													 vector<map<Node*, IPP>>& localQ, queue<LocalWorkItem>& localWorklist, Node& u){
+			if(!followEdge(e, ipp))
+				return;
+
+			// Variables that go on past e, grouped by their paths in progress
+			map<IPP, BitVector> continuing;
+			for(unsigned i : live.set_bits()){
+				// Add to def-use and terminate if we found a def in the same function
+				if(stores->getLastStore(e.first->id, variables[i]) != nullptr && e.first->basicBlock->getParent() == u.basicBlock->getParent()){
+					def_use->insert(variables[i], make_pair(e.first->basicBlock, u.basicBlock));
+					continue;
+				}
 
-			return true;
+				// Do we need to propagate? 
+				map<Node*, IPP>::iterator q = localQ[i].find(e.first);
+				if(q == localQ[i].end())
+					q = localQ[i].insert(make_pair(e.first, ipp)).first;
+				else if(!q->second.intersectWith(ipp))
+					continue;
+
+				BitVector& group = continuing[q->second];
+				group.resize(variables.size());
+				group.set(i);
+			}
+
+			for(map<IPP, BitVector>::iterator c = continuing.begin(); c != continuing.end(); ++c)
+				localWorklist.emplace(e.first, c->first, std::move(c->second));
 		}
 
 		bool isCallSite(Node* &u){
 				return u->getSuccessors().size() == 1 && (*(u->getSuccessors().begin()))->isEntryOfFunction;
 		}
 
-		// Returns the intersection of two sets
-		IPP intersection_(IPP& s1, IPP& s2){
-			IPP intersect; 
-			set_intersection(s1.begin(),s1.end(),s2.begin(),s2.end(),
-                  		inserter(intersect,intersect.begin()));
-			return intersect;
+		// Converts the detector's sets for an edge into bitsets the first time the edge is seen
+		const EdgeIPPSets& getEdgeSets(tuple<Node*, Node*, CallContext>& resultKey){
+			map<tuple<Node*, Node*, CallContext>, EdgeIPPSets>::iterator it = edgeSets.find(resultKey);
+			if(it != edgeSets.end())
+				return it->second;
+
+			EdgeIPPSets& sets = edgeSets[resultKey];
+			for(pair<QueryID, QueryResolution> p : result->getStartSetFor(resultKey, callStrings, *setCallStrings))
+				sets.startSet.insert(p.first, p.second);
+			for(pair<QueryID, QueryResolution> p : result->getPresentSetFor(resultKey, callStrings, *setCallStrings))
+				sets.presentSet.insert(p.first, p.second);
+			for(pair<QueryID, QueryResolution> p : result->getEndSetFor(resultKey, callStrings, *setCallStrings))
+				sets.endSet.insert(p.first, p.second);
+			return sets;
 		}
 
-		// Retruns the union of two sets 
-		IPP union_(IPP& s1, IPP& s2){
-			IPP union_set; 
-			set_union(s1.begin(),s1.end(),s2.begin(),s2.end(),
-                  		inserter(union_set,union_set.begin()));
-			return union_set;
+		// Query at the top of n after substituting query through it. Paths in progress only hold
+		// queries of the sets, whose substitutions the detection left in the transfer functions.
+		QueryID substitute(Node& n, QueryID query){
+			const TransferFunction<QueryResolution>* transfer = transferFunctions->lookup(n.id, query);
+			assert(transfer && transfer->hasSubstitution && "substituteSetQueries was not run over the sets");
+			return transfer->substitutedQuery;
 		}
 
-		void add_to_def_use(map<string, set<pair<BasicBlock*, BasicBlock*>>> defs, string varName){
-			for(pair<BasicBlock*, BasicBlock*> p : defs[varName])
-				(*def_use)[varName].insert(p);
+		void add_to_def_use(const DefUseMap& defs, Value& v){
+			def_use->insertAll(defs, &v);
 		}
 
 
@@ -250,5 +479,6 @@ namespace{
 
 }
 
+#undef DEBUG_TYPE
 
 #endif
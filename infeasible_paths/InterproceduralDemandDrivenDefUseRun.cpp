@@ -1,9 +1,48 @@
-#include "InterproceduralDemandDrivenDefUse.h"
+#include "InterproceduralDefUseAnalysis.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
 
 using namespace llvm;
 
+static cl::opt<unsigned> DDUThreads("ddu-threads", cl::desc("Number of threads analyzing functions in parallel"), cl::init(1));
+static cl::opt<std::string> DDUCache("ddu-cache", cl::desc("File keeping each function's results between runs, reused while the functions they depend on are unchanged"),
+                                      cl::value_desc("path"));
+static cl::opt<OutputFormat> DDUOutput("ddu-output", cl::desc("How the def-use pairs are written"), outputFormatValues(), cl::init(OutputText));
+static cl::opt<std::string> DDUOutputFile("ddu-output-file", cl::desc("File the def-use pairs are written to, - for stdout (default: stderr)"),
+                                          cl::value_desc("path"));
+static cl::opt<bool> DDUBatchVariables("ddu-batch-variables", cl::desc("Walk the local variables loaded at the same node together"), cl::init(true));
+static cl::opt<unsigned> DDUMaxSteps("ddu-max-detection-steps", cl::desc("Step 1 work items the detection in each function may take, 0 for no limit"),
+                                     cl::init(0));
+static cl::opt<unsigned> DDUMaxVisits("ddu-max-visits", cl::desc("(node, query) visits the detection in each function may make, 0 for no limit"),
+                                      cl::init(0));
+static cl::opt<unsigned> DDUMaxCallDepth("ddu-max-call-depth", cl::desc("How deep the detection may follow calls: 1 enters callees but not the functions they call, 0 for no limit"),
+                                         cl::init(0));
+static cl::opt<double> DDUMaxSeconds("ddu-max-detection-seconds", cl::desc("Seconds the detection in each function may take, 0 for no limit"),
+                                     cl::init(0));
+static cl::opt<unsigned> DDUMaxWalkSteps("ddu-max-walk-steps", cl::desc("Work items each def-use walk may take, 0 for no limit"), cl::init(0));
+static cl::opt<double> DDUMaxWalkSeconds("ddu-max-walk-seconds", cl::desc("Seconds each def-use walk may take, 0 for no limit"), cl::init(0));
+
 namespace {
 
+  DetectionBudget detectionBudget() {
+    DetectionBudget budget;
+    budget.steps = DDUMaxSteps;
+    budget.visits = DDUMaxVisits;
+    budget.callDepth = DDUMaxCallDepth;
+    budget.seconds = DDUMaxSeconds;
+    return budget;
+  }
+
+  WalkBudget walkBudget() {
+    WalkBudget budget;
+    budget.steps = DDUMaxWalkSteps;
+    budget.seconds = DDUMaxWalkSeconds;
+    return budget;
+  }
+
   class InterproceduralDemandDrivenDefUseRun: public ModulePass {
   private:
 
@@ -13,31 +52,12 @@ namespace {
     InterproceduralDemandDrivenDefUseRun() : ModulePass(ID) {}
 
     bool runOnModule(Module &M) override {
-			int numberOfPairs = 0;
-
-			for(Module::iterator f = M.begin(); f != M.end(); ++f){
-				Function &F = *f;
-				errs() << "[*] Performing def-use analysis on " << F.getName() << "\n";
-
-
-				map<string, set<pair<BasicBlock*, BasicBlock*>>>  def_use;
-				set<string> localVar; 
-				for(BasicBlock& B : F)
-					InterproceduralDemandDrivenDefUse().startBlockAnalysis(B, M, def_use, localVar);
-
-				map<string, set<pair<BasicBlock*, BasicBlock*>>>::iterator it;
-				for (it = def_use.begin(); it != def_use.end(); ++it){
-						errs() << "\t[$] Def-Use(" << it->first << "): ";
-
-						for(pair<BasicBlock*, BasicBlock*> p : it->second){
-							numberOfPairs++;
-							errs() << "(" << p.first->getParent()->getName() << ":" << p.first->getName() << ", " << p.second->getParent()->getName() << ":" << p.second->getName() << ") ";
-						}
-						errs() << "\n"; 
-				}
-			}
-
-			errs() <<"[*] Total of " << numberOfPairs << " pairs were found. \n";
+			ModuleInfeasiblePathInfo info = ModuleInfeasiblePathAnalysis::compute(M, DDUThreads, DDUCache, detectionBudget());
+			ModuleDefUses defUses = ModuleDefUseAnalysis::compute(M, info, DDUThreads, DDUBatchVariables, walkBudget());
+			saveResultCache(info, errs());
+			printBudgetFallbacks(info, defUses, errs());
+			ResultWriter writer(DDUOutput, DDUOutputFile);
+			writeDefUses(writer, M, defUses);
 
       return false;
     }
@@ -52,3 +72,24 @@ namespace {
 char InterproceduralDemandDrivenDefUseRun::ID = 0;
 static RegisterPass<InterproceduralDemandDrivenDefUseRun> X("InterproceduralDemandDrivenDefUseRun", "Computes def-use pairs utilizing the infeasible paths information across procedures", true, true);
 
+#if LLVM_VERSION_MAJOR >= 7
+// New pass manager entry point, for opt -load-pass-plugin. Registers the analyses as
+// ipd-infeasible-paths and ipd-def-use, so passes can ask for them and require<> or invalidate<>
+// work in pipelines, and print<ipd-def-use> to print the cached pairs.
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return { LLVM_PLUGIN_API_VERSION, "InterproceduralDemandDrivenDefUse", LLVM_VERSION_STRING, [](PassBuilder& PB) {
+    PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager& MAM) {
+      MAM.registerPass([] { return ModuleInfeasiblePathAnalysis(DDUThreads, DDUCache, detectionBudget()); });
+      MAM.registerPass([] { return ModuleDefUseAnalysis(DDUThreads, DDUBatchVariables, walkBudget()); });
+    });
+    PB.registerPipelineParsingCallback([](StringRef name, ModulePassManager& MPM, ArrayRef<PassBuilder::PipelineElement>) {
+      if (name == "print<ipd-def-use>") {
+        MPM.addPass(ModuleDefUsePrinterPass(DDUOutput, DDUOutputFile));
+        return true;
+      }
+      return parseAnalysisUtilityPasses<ModuleInfeasiblePathAnalysis>("ipd-infeasible-paths", name, MPM) ||
+             parseAnalysisUtilityPasses<ModuleDefUseAnalysis>("ipd-def-use", name, MPM);
+    });
+  }};
+}
+#endif
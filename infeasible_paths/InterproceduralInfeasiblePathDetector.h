@@ -1,6 +1,8 @@
 #ifndef INFEASIBLEPATHDETECTOR_H_
 #define INFEASIBLEPATHDETECTOR_H_
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/SmallPtrSet.h"
@@ -8,6 +10,7 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/Support/raw_ostream.h"
@@ -19,27 +22,31 @@
 #include <stack>
 #include <tuple>
 #include <algorithm>
+#include <type_traits>
+#include <chrono>
 
 #include "Node.h"
+#include "QueryInterner.h"
+#include "CallStringTrie.h"
+#include "PropagationOrder.h"
+#include "TransferFunctionCache.h"
 
 using namespace llvm;
 
-namespace {
+#define DEBUG_TYPE "infeasible-paths"
 
-  bool checkIfStackIsSubset(std::stack<Node*> potentialSuper, std::stack<Node*> potentialSub) {
-    if (potentialSub.size() > potentialSuper.size()) {
-      return false;
-    }
+namespace {
 
-    for(int i = 0; i < potentialSub.size(); ++i) {
-      if (potentialSuper.top() != potentialSub.top()) {
-        return false;
-      }
-      potentialSuper.pop();
-      potentialSub.pop();
-    }
-    return true;
-  }
+  STATISTIC(NumStepOneItems, "Work items taken off the step 1 worklist");
+  STATISTIC(NumVisits, "(node, query) pairs visited");
+  STATISTIC(NumResolvedTrue, "Queries resolved true");
+  STATISTIC(NumResolvedFalse, "Queries resolved false");
+  STATISTIC(NumResolvedUndefined, "Queries resolved undefined");
+  STATISTIC(MaxCallDepth, "Deepest calling context entered in step 1");
+  STATISTIC(NumStepTwoNodes, "Nodes taken off the step 2 worklist");
+  STATISTIC(NumStepTwoChanges, "Resolution sets grown in step 2");
+  STATISTIC(NumBudgetFallbacks, "Branches that ran out of a detection budget");
+  STATISTIC(NumUndefinedByBudget, "Queries left undefined when a budget ran out");
 
   enum QueryOperator { 
     IsTrue, 
@@ -65,20 +72,12 @@ namespace {
       rhs = nullptr;
       queryOperator = IsTrue;
       isSummaryNodeQuery = false;
-      originalQuery = nullptr;
-    }
-
-    ~Query() {
-      if (originalQuery != nullptr) {
-        delete originalQuery;
-      }
     }
 
     Value* lhs;
     QueryOperator queryOperator;
     ConstantInt* rhs;
     bool isSummaryNodeQuery;
-    Query* originalQuery;
     // std::stack<std::pair<unsigned, ConstantInt*>> intermediateOperations;
 
     bool operator==(const Query& other) const {
@@ -100,34 +99,51 @@ namespace {
       }
       return this->lhs < other.lhs;
     }
+
+    QueryKey getKey() const {
+      QueryKey key = { lhs, queryOperator, rhs, isSummaryNodeQuery };
+      return key;
+    }
   };
 
-  struct  InfeasiblePathResult {
-    std::map<std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> startSet;
-    std::map<std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> presentSet;
-    std::map<std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>> endSet;
+  // Queries are copied on every substitution, so they must stay plain values.
+  static_assert(std::is_trivially_copyable<Query>::value, "Query must be trivially copyable");
 
-    std::set<std::pair<Query, QueryResolution>> getStartSetFor(std::tuple<Node*, Node*, std::stack<Node*>> key) {
-      return querySet(key, startSet);
+  struct  InfeasiblePathResult {
+    std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>> startSet;
+    std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>> presentSet;
+    std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>> endSet;
+
+    // Elements of an edge's set whose calling context matches the key's. The key's context is one of
+    // keyCallStrings and the sets' are of callStrings, which may be two different tries.
+    std::set<std::pair<QueryID, QueryResolution>> getStartSetFor(std::tuple<Node*, Node*, CallContext> key, const CallStringTrie& keyCallStrings,
+                                                                const CallStringTrie& callStrings) const {
+      return querySet(key, startSet, keyCallStrings, callStrings);
     }
 
-    std::set<std::pair<Query, QueryResolution>> getPresentSetFor(std::tuple<Node*, Node*, std::stack<Node*>> key) {
-      return querySet(key, presentSet);
+    std::set<std::pair<QueryID, QueryResolution>> getPresentSetFor(std::tuple<Node*, Node*, CallContext> key, const CallStringTrie& keyCallStrings,
+                                                                const CallStringTrie& callStrings) const {
+      return querySet(key, presentSet, keyCallStrings, callStrings);
     }
 
-    std::set<std::pair<Query, QueryResolution>> getEndSetFor(std::tuple<Node*, Node*, std::stack<Node*>> key) {
-      return querySet(key, endSet);
+    std::set<std::pair<QueryID, QueryResolution>> getEndSetFor(std::tuple<Node*, Node*, CallContext> key, const CallStringTrie& keyCallStrings,
+                                                                const CallStringTrie& callStrings) const {
+      return querySet(key, endSet, keyCallStrings, callStrings);
     }
 
   private:
-    std::set<std::pair<Query, QueryResolution>> querySet(std::tuple<Node*, Node*, std::stack<Node*>>& key, std::map<std::pair<Node*, Node*>, std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>>& s) {
-      auto matchesKey = [&key](std::tuple<Query, QueryResolution, std::stack<Node*>> t) { return checkIfStackIsSubset(std::get<2>(key), std::get<2>(t)); };
+    static std::set<std::pair<QueryID, QueryResolution>> querySet(std::tuple<Node*, Node*, CallContext>& key, const std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>& s, const CallStringTrie& keyCallStrings, const CallStringTrie& callStrings) {
+      auto matchesKey = [&key, &keyCallStrings, &callStrings](std::tuple<QueryID, QueryResolution, CallContext> t) { return keyCallStrings.endsWith(std::get<2>(key), callStrings, std::get<2>(t)); };
 
-      const auto& resultsToCheck = s[std::make_pair(std::get<0>(key), std::get<1>(key))];
+      std::set<std::pair<QueryID, QueryResolution>> resultSet;
+      auto edge = s.find(std::make_pair(std::get<0>(key), std::get<1>(key)));
+      if (edge == s.end()) {
+        return resultSet;
+      }
+      const auto& resultsToCheck = edge->second;
 
-      std::set<std::tuple<Query, QueryResolution, std::stack<Node*>>>::iterator result = std::find_if(resultsToCheck.begin(), resultsToCheck.end(), matchesKey);
+      std::set<std::tuple<QueryID, QueryResolution, CallContext>>::const_iterator result = std::find_if(resultsToCheck.begin(), resultsToCheck.end(), matchesKey);
 
-      std::set<std::pair<Query, QueryResolution>> resultSet;
       while(result != resultsToCheck.end()) {
         auto r = *result;
         resultSet.insert(std::make_pair(std::get<0>(r), std::get<1>(r)));
@@ -138,269 +154,457 @@ namespace {
 
   };
 
+  typedef std::set<std::pair<QueryResolution, CallContext>> ResolutionSet;
+
+  // Order step 2 takes nodes off its worklist in: by node ID, as it used to, or by strongly
+  // connected component of the visited nodes with reverse postorder inside each. Both reach the
+  // same sets; the second takes fewer nodes off the worklist.
+  enum Step2Order { Step2LegacyOrder, Step2ComponentOrder };
+
+  // Limits on the work step 1 does for each branch, or for all the branches of a function together,
+  // 0 meaning no limit: work items taken off its worklist or the worklists of the callee summaries it
+  // computes, (node, query) visits, depth of the calling context and wall time. Once one runs out, the queries still on the worklist resolve to
+  // QueryUndefined where they are. A query that would enter a callee deeper than the depth limit
+  // resolves to QueryUndefined at the return site. Callee summaries cut off by a budget are not
+  // cached, so other branches compute them under their own budgets. Undefined never makes a path
+  // infeasible, so the sets only lose edges.
+  struct DetectionBudget {
+    DetectionBudget() : steps(0), visits(0), callDepth(0), seconds(0) {}
+
+    unsigned steps;
+    unsigned visits;
+    unsigned callDepth;
+    double seconds;
+  };
+
+  // Budgets a branch ran out of.
+  enum ExceededBudget { StepBudget = 1, VisitBudget = 2, CallDepthBudget = 4, TimeBudget = 8 };
+
+  // Prints the budgets in exceeded, a set of ExceededBudget flags, as a list of their names.
+  inline void printExceededBudgets(unsigned exceeded, raw_ostream& out) {
+    const char* names[] = { "step", "visit", "call depth", "time" };
+    bool first = true;
+    for (unsigned i = 0; i < 4; ++i) {
+      if (exceeded & (1u << i)) {
+        out << (first ? "" : ", ") << names[i];
+        first = false;
+      }
+    }
+  }
+
+  // What step 1 does with a query that enters a callee backwards through one of its exit nodes: the
+  // nodes it visits and the queries it resolves inside the callee, and the queries that leave
+  // through the callee's entry to continue at the call site. None of it depends on the calling
+  // context, so one summary serves every call site. Each call site that reaches the exit continues
+  // with the entry queries as visits of its own, so step 2 carries the resolutions found before the
+  // call through the callee and back out, where the old per-branch walk only returned to the first
+  // call site and did not mark it visited.
+  struct CalleeSummary {
+    CalleeSummary() : isComplete(true), inProgress(true) {}
+
+    std::set<QueryID> entryQueries;
+    std::vector<std::pair<unsigned, QueryID>> visitedQueries;
+    std::vector<std::tuple<unsigned, QueryID, QueryResolution>> resolvedQueries;
+    // Summaries of the calls made from inside the callee.
+    std::vector<unsigned> nestedSummaries;
+    // False if the walk reached a recursive call whose summary was still being computed, or was cut
+    // off by a budget. Such calls are walked the old way, with the calling context on the worklist.
+    bool isComplete;
+    bool inProgress;
+  };
+
+  // Callee summaries keyed on (exit node ID, query at that exit).
+  struct CalleeSummaryCache {
+    std::vector<CalleeSummary> summaries;
+    DenseMap<std::pair<unsigned, QueryID>, unsigned> summaryForExit;
+    // Slots of abandoned summaries, which nothing nests. The next summary started takes one of them.
+    std::vector<unsigned> abandonedSummaries;
+  };
+
+  // Tables that depend only on the module, shared by every detector and def-use query over the same
+  // ICFG and never reset between branches. They are filled in lazily, so threads detecting paths in
+  // the same module each need their own.
+  struct ModuleQueryState {
+    QueryInterner<Query> queries;
+    CallStringTrie callStrings;
+    TransferFunctionCache<unsigned, QueryResolution> transferFunctions;
+    CalleeSummaryCache calleeSummaries;
+  };
+
   class InfeasiblePathDetector {
   private:
-    std::map<std::pair<Query, Node*>, std::set<std::pair<QueryResolution, std::stack<Node*>>>> queryResolutions;
-    std::set<std::pair<Query, Node*>> queriesResolvedInNode;
-    Node* trueDestinationNode;
-    Node* falseDestinationNode;
-    Node* initialNode;
-    std::set<Query> queriesPropagatedToCallers;
+    // Query at a node and the calling context it arrived in.
+    typedef std::tuple<Node*, QueryID, CallContext> WorkItem;
+
+    // Per-branch side tables indexed by Node::id. Only the entries touched by the previous branch
+    // are reset, so their cost does not grow with the size of the module.
+    std::vector<std::map<QueryID, ResolutionSet>> queryResolutions;
+    std::vector<std::set<QueryID>> queriesResolvedInNode;
+    std::vector<std::vector<QueryID>> visited;
+    std::vector<unsigned> touchedNodes;
+    std::vector<bool> nodeTouched;
+    // Every (node, query) visit of the branch.
+    std::vector<std::pair<unsigned, QueryID>> visits;
+    DenseMap<std::pair<unsigned, QueryID>, unsigned> visitIds;
+    std::vector<unsigned> replayedSummaries;
+    std::vector<bool> summaryReplayed;
+    Function* analyzedFunction;
+    ICFG* graph;
+    std::set<QueryID> queriesPropagatedToCallers;
+    QueryInterner<Query>* queries;
+    CallStringTrie* callStrings;
+    TransferFunctionCache<unsigned, QueryResolution>* transferFunctions;
+    CalleeSummaryCache* calleeSummaries;
+    Step2Order step2Order;
+    PropagationOrder propagationOrder;
+    DenseMap<unsigned, unsigned> localIndexOfNode;
+    bool timePhases;
+    DetectionBudget budget;
+    DetectionBudget functionBudget;
+    // Budgets the last branch ran out of
+    unsigned exceededBudgets;
+    // Work items step 1 and its summaries have taken so far, and when step 1 started
+    unsigned budgetSteps;
+    std::chrono::steady_clock::time_point budgetStart;
+    // Work items and visits of the branches detected since setFunctionBudget, and when it was called
+    unsigned functionSteps;
+    size_t functionVisits;
+    std::chrono::steady_clock::time_point functionStart;
 
   public:
-    InfeasiblePathDetector() {}
+    explicit InfeasiblePathDetector(ModuleQueryState& state, Step2Order step2Order = Step2ComponentOrder)
+      : queries(&state.queries), callStrings(&state.callStrings), transferFunctions(&state.transferFunctions),
+        calleeSummaries(&state.calleeSummaries), step2Order(step2Order), timePhases(TimePassesIsEnabled), exceededBudgets(0),
+        budgetSteps(0), functionSteps(0), functionVisits(0) {}
+
+    // The step timers are shared by every detector, so detectors running on several threads at once
+    // must not use them.
+    void setTimePhases(bool enabled) {
+      timePhases = enabled;
+    }
 
-    void detectPaths(Node& incomingNode, InfeasiblePathResult& result, Module& m) {
-      initialNode = &incomingNode;
+    void setBudget(const DetectionBudget& limits) {
+      budget = limits;
+    }
+
+    // Limits on all the branches detected from now on together, on top of the limits of each. The
+    // call depth does not add up across branches, so its limit applies to each of them.
+    void setFunctionBudget(const DetectionBudget& limits) {
+      functionBudget = limits;
+      functionSteps = 0;
+      functionVisits = 0;
+      functionStart = std::chrono::steady_clock::now();
+    }
+
+    // ExceededBudget flags of the budgets the last branch ran out of, 0 if its sets are exact.
+    unsigned getExceededBudgets() const {
+      return exceededBudgets;
+    }
+
+    QueryInterner<Query>& getQueries() {
+      return *queries;
+    }
+
+    CallStringTrie& getCallStrings() {
+      return *callStrings;
+    }
+
+    // Functions whose nodes the last branch's walks reached, which its results depend on.
+    void getTouchedFunctions(SmallPtrSetImpl<Function*>& functions) const {
+      for (unsigned id : touchedNodes) {
+        functions.insert(graph->getNode(id)->basicBlock->getParent());
+      }
+    }
+
+    // Detects the infeasible paths of one branch. A detector may be reused for any number of
+    // branches, one after another: they share the module's transfer functions and callee summaries,
+    // which do not depend on the calling context, and the storage of the side tables, which are
+    // reset between them, so each branch gets the sets it would get on its own.
+    void detectPaths(Node& branchNode, InfeasiblePathResult& result) {
+      Node* initialNode = &branchNode;
+      exceededBudgets = 0;
       if (!initialNode->endsWithConditionalBranch()) {
         return;
       }
 
-      queryResolutions.clear();
-      queriesResolvedInNode.clear();
+      graph = &initialNode->getGraph();
+      analyzedFunction = initialNode->basicBlock->getParent();
+      resetSideTables(graph->size());
       queriesPropagatedToCallers.clear();
 
-      // Work list contains two nodes since whenever a query gets propagated up, it should continue to the proper call site so we save
-      // the call site with it.
-      std::stack<std::tuple<Node*, Query, std::stack<Node*>>> worklist;
-      std::map<Node*, std::vector<Query>> visited;
+      // Work list items carry the calling context since whenever a query gets propagated up, it should continue to the proper call site.
+      std::stack<WorkItem> worklist;
 
-      Query initialQuery;
-      initialQuery.lhs = initialNode->getBranchCondition();
-      initialQuery.rhs = nullptr;
-      initialQuery.isSummaryNodeQuery = false;
-      initialQuery.queryOperator = IsTrue;
+      Query branchQuery;
+      branchQuery.lhs = initialNode->getBranchCondition();
+      branchQuery.rhs = nullptr;
+      branchQuery.isSummaryNodeQuery = false;
+      branchQuery.queryOperator = IsTrue;
+      QueryID initialQuery = queries->intern(branchQuery);
 
+      worklist.emplace(initialNode, initialQuery, EmptyContext);
+      markVisited(initialNode, initialQuery);
 
-      worklist.push(std::make_tuple(initialNode, initialQuery, std::stack<Node*>()));
-      visited[initialNode].push_back(initialQuery);
+      {
+        NamedRegionTimer timer("step1", "Step 1", "infeasible-paths", "Infeasible path detection", timePhases);
+        executeStepOne(worklist, *initialNode, initialQuery, result);
+      }
+      functionSteps += budgetSteps;
+      functionVisits += visits.size();
+      if (exceededBudgets != 0) {
+        ++NumBudgetFallbacks;
+      }
 
-      trueDestinationNode = initialNode->getTrueEdge();
-      falseDestinationNode = initialNode->getFalseEdge();
+      // Step 2
+      {
+        NamedRegionTimer timer("step2", "Step 2", "infeasible-paths", "Infeasible path detection", timePhases);
+        executeStepTwo();
+      }
 
-      std::map<std::pair<Function*, Query>, std::set<Query>> functionQueryCache;
+      // Step 3
+      NamedRegionTimer timer("step3", "Step 3", "infeasible-paths", "Infeasible path detection", timePhases);
+      executeStepThree(*initialNode, initialQuery, result);
+    }
 
-      executeStepOne(worklist, visited, initialQuery, result, functionQueryCache);
+    // Propagates the resolutions found in step 1 forward to the visits that did not resolve their
+    // query, until no resolution set grows. Every set is joined with addResolution(), so the fixpoint,
+    // and with it the sets, do not depend on the order nodes are taken off the worklist in.
+    void executeStepTwo() {
+      // Worklist keys are node IDs in the legacy order and ranks in propagationOrder otherwise.
+      std::set<unsigned> step2WorkList;
+      if (step2Order == Step2ComponentOrder) {
+        computePropagationOrder();
+      }
 
-      // Step 2
-      std::set<Node*> step2WorkList;
-      for (std::pair<const std::pair<Query, Node*>, std::set<std::pair<QueryResolution, std::stack<Node*>>>> resolvedNode : queryResolutions) {
-        Node* n = resolvedNode.first.second;
-        for (Node* succ : n->getSuccessors()) {
-          step2WorkList.insert(succ);
+      for (unsigned id : touchedNodes) {
+        if (!queryResolutions[id].empty()) {
+          for (Node* succ : graph->getNode(id)->getSuccessors()) {
+            pushStepTwo(step2WorkList, succ);
+          }
         }
       }
 
       while (step2WorkList.size() != 0) {
-        std::set<Node*>::iterator nIter = step2WorkList.begin();
-        Node* n = *nIter;
+        std::set<unsigned>::iterator nIter = step2WorkList.begin();
+        Node* n = step2Order == Step2ComponentOrder ? graph->getNode(touchedNodes[propagationOrder.getNode(*nIter)]) : graph->getNode(*nIter);
         step2WorkList.erase(nIter);
+        ++NumStepTwoNodes;
 
-        for(Query query : visited[n]) {
+        bool changed = false;
+        for(QueryID query : visited[n->id]) {
 
-          std::pair<Query, Node*> currentBlockAndQuery = std::make_pair(query, n);
-          
-          if (queriesResolvedInNode.count(currentBlockAndQuery) != 0) {
+          if (queriesResolvedInNode[n->id].count(query) != 0) {
             continue;
           }
 
-          std::map<Node*, Query> substituteMap;
-          substitute(*n, query, substituteMap);
-          for (Node* pred : n->getPredecessors()) {
-            size_t currentNumberResultsForBlock = queryResolutions[currentBlockAndQuery].size();
-            for(std::pair<QueryResolution, std::stack<Node*>> qr : queryResolutions[std::make_pair(substituteMap[pred], pred)]) {
+          ResolutionSet& currentResolutions = queryResolutions[n->id][query];
+          bool grew = false;
+          ArrayRef<Node*> preds = n->getPredecessors();
+          ArrayRef<QueryID> predQueries = substituteToPredecessors(*n, query);
+          for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+            Node* pred = preds[predIndex];
+            for(std::pair<QueryResolution, CallContext> qr : getResolutions(predQueries[predIndex], pred)) {
 
-              std::stack<Node*> stackCopy = qr.second;
+              CallContext context = qr.second;
 
               // prevent propagated queries from other call sites to this return point.
               if (pred->isExitOfFunction) {
                 Node* callSiteOfExitedFunction = n->getPredecessorBypassingFunctionCall();
-                if (qr.second.size() != 0 && qr.second.top() != callSiteOfExitedFunction) {
+                if (!callStrings->empty(qr.second) && callStrings->top(qr.second) != callSiteOfExitedFunction) {
                   continue;
                 }
-                if (qr.second.size() != 0 && qr.second.top() == callSiteOfExitedFunction) {
-                  stackCopy.pop();
+                if (!callStrings->empty(qr.second) && callStrings->top(qr.second) == callSiteOfExitedFunction) {
+                  context = callStrings->pop(context);
                 }
               }
 
               // Make sure queries propagated to function calls are associated with the proper calling context.
               if (n->isEntryOfFunction) {
-                if (n->basicBlock->getParent() != initialNode->basicBlock->getParent() || queriesPropagatedToCallers.count(substituteMap[pred]) == 0) {
+                if (n->basicBlock->getParent() != analyzedFunction || queriesPropagatedToCallers.count(predQueries[predIndex]) == 0) {
                   Node* callSite = pred;
-                  stackCopy.push(callSite);
+                  context = callStrings->push(context, callSite);
                 }
               }
 
               // make sure we don't have the same resolution twice in the same block. It's OK if the same resolution is there for different calling points
-              // but the nullptr ensures that the results looked at are only those shared between all call sites.
-              std::stack<Node*> emptyCallStack;
-              if (queryResolutions[currentBlockAndQuery].count(std::make_pair(qr.first, emptyCallStack)) == 0) {
-                queryResolutions[currentBlockAndQuery].insert(std::make_pair(qr.first, stackCopy));
-              }
-            }
-            if (queryResolutions[currentBlockAndQuery].size() > currentNumberResultsForBlock) {
-              for (Node* succ : n->getSuccessors()) {
-                step2WorkList.insert(succ);
-              }   
+              // but the empty context ensures that the results looked at are only those shared between all call sites.
+              grew = addResolution(currentResolutions, qr.first, context) || grew;
             }
           }
+          if (grew) {
+            ++NumStepTwoChanges;
+            changed = true;
+          }
         }
-      }
 
-      // Step 3
-      std::stack<Node*> emptyCallStack;
-      if (queryResolutions[std::make_pair(initialQuery, initialNode)].count(std::make_pair(QueryTrue, emptyCallStack)) > 0) {
-        result.endSet[std::make_pair(initialNode, trueDestinationNode)].insert(std::make_tuple(initialQuery, QueryTrue, emptyCallStack));
-        visited[trueDestinationNode].push_back(initialQuery);
+        // Successors only need another look if something they read from n changed.
+        if (changed) {
+          for (Node* succ : n->getSuccessors()) {
+            pushStepTwo(step2WorkList, succ);
+          }
+        }
       }
+    }
 
-      if (queryResolutions[std::make_pair(initialQuery, initialNode)].count(std::make_pair(QueryFalse, emptyCallStack)) > 0) {
-        result.endSet[std::make_pair(initialNode, falseDestinationNode)].insert(std::make_tuple(initialQuery, QueryFalse, emptyCallStack));
-        visited[falseDestinationNode].push_back(initialQuery);
+    // Joins (resolution, context) into resolutions, which hold no pair whose context is a top-aligned
+    // prefix of another's with the same resolution: a shorter context already covers every context
+    // it is a prefix of, and the empty one covers them all. Returns false if a pair in resolutions
+    // already covers it; otherwise adds it in place of the pairs it covers. Since the propagation
+    // only pushes onto or pops off the top of a context, covering is preserved along every edge,
+    // and step 2 reaches the same sets whichever pair reaches a node first.
+    bool addResolution(ResolutionSet& resolutions, QueryResolution resolution, CallContext context) {
+      ResolutionSet::iterator first = resolutions.lower_bound(std::make_pair(resolution, EmptyContext));
+      for (ResolutionSet::iterator it = first; it != resolutions.end() && it->first == resolution; ++it) {
+        if (callStrings->endsWith(context, it->second)) {
+          return false;
+        }
       }
-      
-
-      for (std::pair<Node*, std::vector<Query>> visitedNode : visited) {
-        Node* n = visitedNode.first;
-        for (Query query : visitedNode.second) {
-
-          std::map<Node*, Query> substituteMap;
-          substitute(*n, query, substituteMap);
-          for (Node* pred : n->getPredecessors()) {
-            Query substitutedQuery = substituteMap[pred];
+      for (ResolutionSet::iterator it = first; it != resolutions.end() && it->first == resolution;) {
+        if (callStrings->endsWith(it->second, context)) {
+          it = resolutions.erase(it);
+        }
+        else {
+          ++it;
+        }
+      }
+      resolutions.insert(std::make_pair(resolution, context));
+      return true;
+    }
 
-            std::set<std::stack<Node*>> uniqueCallStacks;
-            for(std::pair<QueryResolution, std::stack<Node*>> qr : queryResolutions[std::make_pair(substitutedQuery, pred)]) {
-              if (qr.first != QueryTrue && qr.first != QueryFalse) {
-                continue;
-              }
-              result.presentSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, qr.first, qr.second));
-              uniqueCallStacks.insert(qr.second);
-            }
+    void pushStepTwo(std::set<unsigned>& step2WorkList, Node* n) {
+      if (step2Order == Step2LegacyOrder) {
+        step2WorkList.insert(n->id);
+      }
+      else if (nodeTouched[n->id]) {
+        // Nodes no query visited have nothing to propagate.
+        step2WorkList.insert(propagationOrder.getRank(localIndexOfNode.lookup(n->id)));
+      }
+    }
 
-            for (std::stack<Node*> callStack : uniqueCallStacks) {
-              if (callStack == emptyCallStack) {
-                auto countNotTruePredicate = [](std::pair<QueryResolution, std::stack<Node*>> p) { return p.first != QueryTrue; };
-                auto countNotFalsePredicate = [](std::pair<QueryResolution, std::stack<Node*>> p) { return p.first != QueryFalse; };
-                if (
-                    queryResolutions[std::make_pair(substitutedQuery, pred)].count(std::make_pair(QueryTrue, callStack)) > 0 
-                    && std::count_if(queryResolutions[std::make_pair(substitutedQuery, pred)].begin(), queryResolutions[std::make_pair(substitutedQuery, pred)].end(), countNotTruePredicate) == 0
-                    && (queryResolutions[std::make_pair(query, n)].size() > 1 || n == trueDestinationNode)
-                  ) {
-                  result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryTrue, callStack));
-                }
-                else if (
-                    queryResolutions[std::make_pair(substitutedQuery, pred)].count(std::make_pair(QueryFalse, callStack)) > 0 
-                    && std::count_if(queryResolutions[std::make_pair(substitutedQuery, pred)].begin(), queryResolutions[std::make_pair(substitutedQuery, pred)].end(), countNotFalsePredicate) == 0
-                    && (queryResolutions[std::make_pair(query, n)].size() > 1 || n == falseDestinationNode)
-                  ) {
-                  result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryFalse, callStack));
-                }
-              }
-              else {
-                auto countNotTruePredicate = [&callStack](std::pair<QueryResolution, std::stack<Node*>> p) { return p.first != QueryTrue && checkIfStackIsSubset(callStack, p.second); };
-                auto countNotFalsePredicate = [&callStack](std::pair<QueryResolution, std::stack<Node*>> p) { return p.first != QueryFalse && checkIfStackIsSubset(callStack, p.second); };
-                if (
-                    queryResolutions[std::make_pair(substitutedQuery, pred)].count(std::make_pair(QueryTrue, callStack)) > 0 
-                    && std::count_if(queryResolutions[std::make_pair(substitutedQuery, pred)].begin(), queryResolutions[std::make_pair(substitutedQuery, pred)].end(), countNotTruePredicate) == 0
-                    && queryResolutions[std::make_pair(query, n)].size() > 1
-                  ) {
-                  result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryTrue, callStack));
-                }
-                else if (
-                    queryResolutions[std::make_pair(substitutedQuery, pred)].count(std::make_pair(QueryFalse, callStack)) > 0 
-                    && std::count_if(queryResolutions[std::make_pair(substitutedQuery, pred)].begin(), queryResolutions[std::make_pair(substitutedQuery, pred)].end(), countNotFalsePredicate) == 0
-                    && queryResolutions[std::make_pair(query, n)].size() > 1
-                  ) {
-                  result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryFalse, callStack));
-                }
-              }
-            }
+    // Ranks the nodes the branch touched, numbered by their position in touchedNodes, along the
+    // successor edges between them.
+    void computePropagationOrder() {
+      localIndexOfNode.clear();
+      for (unsigned index = 0; index < touchedNodes.size(); ++index) {
+        localIndexOfNode[touchedNodes[index]] = index;
+      }
+      std::vector<std::vector<unsigned>> successors(touchedNodes.size());
+      for (unsigned index = 0; index < touchedNodes.size(); ++index) {
+        for (Node* succ : graph->getNode(touchedNodes[index])->getSuccessors()) {
+          if (nodeTouched[succ->id]) {
+            successors[index].push_back(localIndexOfNode.lookup(succ->id));
           }
         }
       }
-
+      propagationOrder.compute(successors);
     }
 
-    void executeStepOne(std::stack<std::tuple<Node*, Query, std::stack<Node*>>>& worklist, std::map<Node*, std::vector<Query>>& visited, 
-                        Query initialQuery, InfeasiblePathResult& result, std::map<std::pair<Function*, Query>, std::set<Query>>& functionQueryCache) {
+    void executeStepOne(std::stack<WorkItem>& worklist, Node& initialNode, QueryID initialQuery, InfeasiblePathResult& result) {
+      budgetStart = std::chrono::steady_clock::now();
+      budgetSteps = 0;
       while(worklist.size() != 0) {
-        std::tuple<Node*, Query, std::stack<Node*>> workItem = worklist.top();
+        WorkItem workItem = worklist.top();
         worklist.pop();
+        ++NumStepOneItems;
+
+        if (exceedsBudget()) {
+          resolveByBudget(std::get<0>(workItem), std::get<1>(workItem));
+          while (!worklist.empty()) {
+            resolveByBudget(std::get<0>(worklist.top()), std::get<1>(worklist.top()));
+            worklist.pop();
+          }
+          break;
+        }
 
         Node* n = std::get<0>(workItem);
-        Query currentValue = std::get<1>(workItem);
-        std::stack<Node*> callStack = std::get<2>(workItem);
+        QueryID currentValue = std::get<1>(workItem);
+        CallContext callStack = std::get<2>(workItem);
 
         QueryResolution resolution;
 
         if(!resolve(*n, currentValue, resolution)) {
 
-          std::map<Node*, Query> substituteMap;
-          currentValue = substitute(*n, currentValue, substituteMap);
+          ArrayRef<Node*> preds = n->getPredecessors();
+          ArrayRef<QueryID> predQueries = substituteToPredecessors(*n, currentValue);
+          currentValue = substitute(*n, currentValue);
           if (n->isEntryOfFunction) {
 
 
             // Reached the starting point of the function under analysis.
-            if (callStack.size() == 0) {
-              if (n->getPredecessors().size() == 0) {
+            if (callStrings->empty(callStack)) {
+              if (preds.size() == 0) {
                 resolution = QueryUndefined;
-                if (n->basicBlock->getParent()->getName() == "main" && isa<GlobalVariable>(currentValue.lhs)) {
-                  GlobalVariable* global = dyn_cast<GlobalVariable>(currentValue.lhs);
+                Query query = queries->get(currentValue);
+                if (n->basicBlock->getParent()->getName() == "main" && isa<GlobalVariable>(query.lhs)) {
+                  GlobalVariable* global = dyn_cast<GlobalVariable>(query.lhs);
                   if (isa<ConstantInt>(global->getInitializer())) {
-                    resolution = resolveConstantAssignment(dyn_cast<ConstantInt>(global->getInitializer()), currentValue);
+                    resolution = resolveConstantAssignment(dyn_cast<ConstantInt>(global->getInitializer()), query);
                   }
                 }
-                queriesResolvedInNode.insert(std::make_pair(currentValue, n));
-                std::stack<Node*> emptyCallStack;
-                queryResolutions[std::make_pair(currentValue, n)].insert(std::make_pair(resolution, emptyCallStack));
+                countResolution(resolution);
+                markTouched(n);
+                queriesResolvedInNode[n->id].insert(currentValue);
+                queryResolutions[n->id][currentValue].insert(std::make_pair(resolution, EmptyContext));
               }
               else{
-                for(Node* pred : n->getPredecessors()) {
-                  queriesPropagatedToCallers.insert(substituteMap[pred]);
-                  if (std::find(visited[pred].begin(), visited[pred].end(), substituteMap[pred]) == visited[pred].end()) {
-                    visited[pred].push_back(substituteMap[pred]);
-                    worklist.push(std::make_tuple(pred, substituteMap[pred], callStack));
+                for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+                  queriesPropagatedToCallers.insert(predQueries[predIndex]);
+                  if (markVisited(preds[predIndex], predQueries[predIndex])) {
+                    worklist.emplace(preds[predIndex], predQueries[predIndex], callStack);
                   }
                 }
               }
             }
             else {
-              functionQueryCache[std::make_pair(n->basicBlock->getParent(), initialQuery)].insert(currentValue);
-              Node* callSite = callStack.top();
-              callStack.pop();
-              worklist.push(std::make_tuple(callSite, currentValue, callStack));
+              Node* callSite = callStrings->top(callStack);
+              callStack = callStrings->pop(callStack);
+              worklist.emplace(callSite, currentValue, callStack);
             }
           }
           else {
-            std::set<Node*> preds = n->getPredecessors();
             if (preds.size() > 0) {
               Node* p = *(preds.begin());
               if (p->isExitOfFunction) {
-                auto callStackCopy = callStack;
-                callStackCopy.push(n->getPredecessorBypassingFunctionCall());
-                for(Node* pred : preds) {
-                  if (std::find(visited[pred].begin(), visited[pred].end(), substituteMap[pred]) == visited[pred].end()) {
-                    visited[pred].push_back(substituteMap[pred]);
-                    worklist.push(std::make_tuple(pred, substituteMap[pred], callStackCopy));
-                  }
+                Node* callNode = n->getPredecessorBypassingFunctionCall();
+                std::vector<unsigned> summaryIds;
+                unsigned callDepthLimit = getCallDepthLimit();
+                bool isTooDeep = callDepthLimit != 0 && callStrings->depth(callStack) >= callDepthLimit;
+                // Checked as each summary comes back: the slot of an abandoned one may already hold
+                // the next exit's summary.
+                bool summariesComplete = true;
+                for (unsigned predIndex = 0; predIndex < preds.size() && !isTooDeep; ++predIndex) {
+                  summaryIds.push_back(getCalleeSummary(preds[predIndex], predQueries[predIndex], callStrings->depth(callStack) + 1));
+                  summariesComplete = summariesComplete && isComplete(summaryIds.back());
                 }
 
-                Function* functionCalled = p->basicBlock->getParent();
-                Node* predecessor = n->getPredecessorBypassingFunctionCall();
-                for(Query q : functionQueryCache[std::make_pair(functionCalled, currentValue)]) {
-                  if (std::find(visited[predecessor].begin(), visited[predecessor].end(), q) == visited[predecessor].end()) {
-                    visited[predecessor].push_back(q);
-                    worklist.push(std::make_tuple(predecessor, q, callStack));
+                if (isTooDeep) {
+                  exceededBudgets |= CallDepthBudget;
+                  resolveByBudget(n, std::get<1>(workItem));
+                }
+                else if (summariesComplete) {
+                  for (unsigned summaryId : summaryIds) {
+                    replayCalleeSummary(summaryId);
+                    for (QueryID q : calleeSummaries->summaries[summaryId].entryQueries) {
+                      if (markVisited(callNode, q)) {
+                        worklist.emplace(callNode, q, callStack);
+                      }
+                    }
+                  }
+                }
+                else {
+                  CallContext callStackCopy = callStrings->push(callStack, callNode);
+                  MaxCallDepth.updateMax(callStrings->depth(callStackCopy));
+                  for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+                    if (markVisited(preds[predIndex], predQueries[predIndex])) {
+                      worklist.emplace(preds[predIndex], predQueries[predIndex], callStackCopy);
+                    }
                   }
                 }
-
               }
               else {
-                for(Node* pred : n->getPredecessors()) {
-                  if (std::find(visited[pred].begin(), visited[pred].end(), substituteMap[pred]) == visited[pred].end()) {
-                    visited[pred].push_back(substituteMap[pred]);
-                    worklist.push(std::make_tuple(pred, substituteMap[pred], callStack));
+                for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+                  if (markVisited(preds[predIndex], predQueries[predIndex])) {
+                    worklist.emplace(preds[predIndex], predQueries[predIndex], callStack);
                   }
                 }
               }
@@ -408,12 +612,16 @@ namespace {
           }
         }
         else {
-          queriesResolvedInNode.insert(std::make_pair(currentValue, n));
-          std::stack<Node*> emptyCallStack;
-          queryResolutions[std::make_pair(currentValue, n)].insert(std::make_pair(resolution, emptyCallStack));
+          countResolution(resolution);
+          markTouched(n);
+          queriesResolvedInNode[n->id].insert(currentValue);
+          CallContext emptyCallStack = EmptyContext;
+          queryResolutions[n->id][currentValue].insert(std::make_pair(resolution, emptyCallStack));
 
           // There is an edge case where the query may becomes resolved instantly. If this is case, just add the branch exit edges to all of the output sets.
-          if (n == initialNode && currentValue == initialQuery) {
+          if (n == &initialNode && currentValue == initialQuery) {
+            Node* trueDestinationNode = n->getTrueEdge();
+            Node* falseDestinationNode = n->getFalseEdge();
             if (resolution == QueryTrue) {
               result.startSet[std::make_pair(n, trueDestinationNode)].insert( std::make_tuple(initialQuery, QueryTrue, emptyCallStack));
               result.presentSet[std::make_pair(n, trueDestinationNode)].insert(std::make_tuple(initialQuery, QueryTrue, emptyCallStack));
@@ -424,18 +632,452 @@ namespace {
               result.presentSet[std::make_pair(n, falseDestinationNode)].insert(std::make_tuple(initialQuery, QueryFalse, emptyCallStack));
               result.endSet[std::make_pair(n, falseDestinationNode)].insert(std::make_tuple(initialQuery, QueryFalse, emptyCallStack));
             }
+          }
+        }
+      }
+    }
+
+    void executeStepThree(Node& branchNode, QueryID initialQuery, InfeasiblePathResult& result) {
+      Node* initialNode = &branchNode;
+      Node* trueDestinationNode = initialNode->getTrueEdge();
+      Node* falseDestinationNode = initialNode->getFalseEdge();
+
+      CallContext emptyCallStack = EmptyContext;
+      if (getResolutions(initialQuery, initialNode).count(std::make_pair(QueryTrue, emptyCallStack)) > 0) {
+        result.endSet[std::make_pair(initialNode, trueDestinationNode)].insert(std::make_tuple(initialQuery, QueryTrue, emptyCallStack));
+        markVisited(trueDestinationNode, initialQuery);
+      }
+
+      if (getResolutions(initialQuery, initialNode).count(std::make_pair(QueryFalse, emptyCallStack)) > 0) {
+        result.endSet[std::make_pair(initialNode, falseDestinationNode)].insert(std::make_tuple(initialQuery, QueryFalse, emptyCallStack));
+        markVisited(falseDestinationNode, initialQuery);
+      }
+
+      for (const std::pair<unsigned, QueryID>& visit : visits) {
+        Node* n = graph->getNode(visit.first);
+        QueryID query = visit.second;
+
+        ArrayRef<Node*> preds = n->getPredecessors();
+        ArrayRef<QueryID> predQueries = substituteToPredecessors(*n, query);
+        for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+          Node* pred = preds[predIndex];
+          QueryID substitutedQuery = predQueries[predIndex];
+
+          std::set<CallContext> uniqueCallStacks;
+          const ResolutionSet& predResolutions = getResolutions(substitutedQuery, pred);
+          const ResolutionSet& currentResolutions = getResolutions(query, n);
+          for(std::pair<QueryResolution, CallContext> qr : predResolutions) {
+            if (qr.first != QueryTrue && qr.first != QueryFalse) {
+              continue;
+            }
+            result.presentSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, qr.first, qr.second));
+            uniqueCallStacks.insert(qr.second);
+          }
+
+          for (CallContext callStack : uniqueCallStacks) {
+            if (callStack == emptyCallStack) {
+              auto countNotTruePredicate = [](std::pair<QueryResolution, CallContext> p) { return p.first != QueryTrue; };
+              auto countNotFalsePredicate = [](std::pair<QueryResolution, CallContext> p) { return p.first != QueryFalse; };
+              if (
+                  predResolutions.count(std::make_pair(QueryTrue, callStack)) > 0 
+                  && std::count_if(predResolutions.begin(), predResolutions.end(), countNotTruePredicate) == 0
+                  && (currentResolutions.size() > 1 || n == trueDestinationNode)
+                ) {
+                result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryTrue, callStack));
+              }
+              else if (
+                  predResolutions.count(std::make_pair(QueryFalse, callStack)) > 0 
+                  && std::count_if(predResolutions.begin(), predResolutions.end(), countNotFalsePredicate) == 0
+                  && (currentResolutions.size() > 1 || n == falseDestinationNode)
+                ) {
+                result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryFalse, callStack));
+              }
+            }
+            else {
+              CallStringTrie& trie = *callStrings;
+              auto countNotTruePredicate = [&callStack, &trie](std::pair<QueryResolution, CallContext> p) { return p.first != QueryTrue && trie.endsWith(callStack, p.second); };
+              auto countNotFalsePredicate = [&callStack, &trie](std::pair<QueryResolution, CallContext> p) { return p.first != QueryFalse && trie.endsWith(callStack, p.second); };
+              if (
+                  predResolutions.count(std::make_pair(QueryTrue, callStack)) > 0 
+                  && std::count_if(predResolutions.begin(), predResolutions.end(), countNotTruePredicate) == 0
+                  && currentResolutions.size() > 1
+                ) {
+                result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryTrue, callStack));
+              }
+              else if (
+                  predResolutions.count(std::make_pair(QueryFalse, callStack)) > 0 
+                  && std::count_if(predResolutions.begin(), predResolutions.end(), countNotFalsePredicate) == 0
+                  && currentResolutions.size() > 1
+                ) {
+                result.startSet[std::make_pair(pred, n)].insert(std::make_tuple(substitutedQuery, QueryFalse, callStack));
+              }
+            }
+          }
+        }
+      }
+    }
+
+    void resetSideTables(unsigned numberOfNodes) {
+      for (unsigned id : touchedNodes) {
+        queryResolutions[id].clear();
+        queriesResolvedInNode[id].clear();
+        visited[id].clear();
+        nodeTouched[id] = false;
+      }
+      touchedNodes.clear();
+
+      visits.clear();
+      visitIds.clear();
+
+      for (unsigned summaryId : replayedSummaries) {
+        summaryReplayed[summaryId] = false;
+      }
+      replayedSummaries.clear();
+
+      queryResolutions.resize(numberOfNodes);
+      queriesResolvedInNode.resize(numberOfNodes);
+      visited.resize(numberOfNodes);
+      nodeTouched.resize(numberOfNodes, false);
+    }
+
+    void markTouched(Node* n) {
+      if (!nodeTouched[n->id]) {
+        nodeTouched[n->id] = true;
+        touchedNodes.push_back(n->id);
+      }
+    }
+
+    // Records that query has reached n. Returns false if it had already been there.
+    bool markVisited(Node* n, QueryID query) {
+      if (!visitIds.insert(std::make_pair(std::make_pair(n->id, query), (unsigned)visits.size())).second) {
+        return false;
+      }
+      ++NumVisits;
+      markTouched(n);
+      visited[n->id].push_back(query);
+      visits.push_back(std::make_pair(n->id, query));
+      return true;
+    }
+
+    // Charges one work item to the branch's and the function's budget and records the budgets step 1
+    // has run out of. The clock is only read on a branch's first item and every 256 items after it.
+    bool exceedsBudget() {
+      unsigned steps = ++budgetSteps;
+      if ((budget.steps != 0 && steps > budget.steps) || (functionBudget.steps != 0 && functionSteps + steps > functionBudget.steps)) {
+        exceededBudgets |= StepBudget;
+      }
+      if ((budget.visits != 0 && visits.size() > budget.visits) ||
+          (functionBudget.visits != 0 && functionVisits + visits.size() > functionBudget.visits)) {
+        exceededBudgets |= VisitBudget;
+      }
+      if ((budget.seconds != 0 || functionBudget.seconds != 0) && (steps == 1 || steps % 256 == 0)) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if ((budget.seconds != 0 && std::chrono::duration<double>(now - budgetStart).count() > budget.seconds) ||
+            (functionBudget.seconds != 0 && std::chrono::duration<double>(now - functionStart).count() > functionBudget.seconds)) {
+          exceededBudgets |= TimeBudget;
+        }
+      }
+      return (exceededBudgets & ~CallDepthBudget) != 0;
+    }
+
+    // Deepest calling context step 1 may enter under the branch's and the function's limits, 0 for
+    // no limit.
+    unsigned getCallDepthLimit() const {
+      if (budget.callDepth == 0 || (functionBudget.callDepth != 0 && functionBudget.callDepth < budget.callDepth)) {
+        return functionBudget.callDepth;
+      }
+      return budget.callDepth;
+    }
+
+    // Gives up on query at n, which the sets then treat as unknown along every path through n.
+    void resolveByBudget(Node* n, QueryID query) {
+      ++NumUndefinedByBudget;
+      countResolution(QueryUndefined);
+      markTouched(n);
+      queriesResolvedInNode[n->id].insert(query);
+      queryResolutions[n->id][query].insert(std::make_pair(QueryUndefined, EmptyContext));
+    }
+
+    static void countResolution(QueryResolution resolution) {
+      if (resolution == QueryTrue) {
+        ++NumResolvedTrue;
+      }
+      else if (resolution == QueryFalse) {
+        ++NumResolvedFalse;
+      }
+      else {
+        ++NumResolvedUndefined;
+      }
+    }
+
+    // Summary whose context-free walk is in progress, with the queries it has left to walk and the
+    // ones it has seen.
+    struct SummaryWalk {
+      unsigned summaryId;
+      std::pair<unsigned, QueryID> exit;
+      std::vector<std::pair<Node*, QueryID>> worklist;
+      DenseSet<std::pair<unsigned, QueryID>> seen;
+    };
+
+    // Returns the ID of the summary for query entering a callee backwards through exitNode, computing
+    // it with a context-free walk of the callee the first time it is needed. A walk that reaches a
+    // nested call whose summary is missing starts that summary's walk on top of its own and comes back
+    // to the call once it is done, so call chains of any depth take no space on the call stack.
+    // callDepth is the depth of the calling context the callee runs in. A walk that runs out of budget,
+    // or reaches a call nested past the depth limit, abandons every summary it has in progress. They
+    // come back incomplete, so the walk carrying the calling context takes over and stops at the
+    // budget.
+    unsigned getCalleeSummary(Node* exitNode, QueryID exitQuery, unsigned callDepth) {
+      std::vector<SummaryWalk> walks;
+      unsigned summaryId;
+      if (!startCalleeSummary(exitNode, exitQuery, walks, summaryId)) {
+        return summaryId;
+      }
+
+      std::vector<CalleeSummary>& summaries = calleeSummaries->summaries;
+      while (!walks.empty()) {
+        if (exceedsBudget()) {
+          abandonCalleeSummaries(walks);
+          break;
+        }
+
+        SummaryWalk& walk = walks.back();
+        CalleeSummary& summary = summaries[walk.summaryId];
+        if (walk.worklist.empty()) {
+          summary.inProgress = false;
+          walks.pop_back();
+          continue;
+        }
+
+        // The item stays on the worklist until the summaries of the calls it reaches exist.
+        Node* n = walk.worklist.back().first;
+        QueryID query = walk.worklist.back().second;
+
+        QueryResolution resolution;
+        if (resolve(*n, query, resolution)) {
+          walk.worklist.pop_back();
+          summary.resolvedQueries.push_back(std::make_tuple(n->id, query, resolution));
+          continue;
+        }
+
+        ArrayRef<Node*> preds = n->getPredecessors();
+        ArrayRef<QueryID> predQueries = substituteToPredecessors(*n, query);
+        if (n->isEntryOfFunction) {
+          walk.worklist.pop_back();
+          summary.entryQueries.insert(substitute(*n, query));
+          continue;
+        }
+        if (preds.size() == 0) {
+          walk.worklist.pop_back();
+          continue;
+        }
+
+        std::vector<std::pair<Node*, QueryID>> next;
+        if (preds[0]->isExitOfFunction) {
+          // Nested call: continue at its call site with the nested callee's entry queries.
+          std::vector<unsigned> nestedIds;
+          bool startedNested = false;
+          bool isTooDeep = false;
+          unsigned callDepthLimit = getCallDepthLimit();
+          for (unsigned predIndex = 0; predIndex < preds.size() && !startedNested; ++predIndex) {
+            if (callDepthLimit != 0 && callDepth + walks.size() > callDepthLimit &&
+                calleeSummaries->summaryForExit.count(std::make_pair(preds[predIndex]->id, predQueries[predIndex])) == 0) {
+              exceededBudgets |= CallDepthBudget;
+              isTooDeep = true;
+              break;
+            }
+            unsigned nestedId;
+            startedNested = startCalleeSummary(preds[predIndex], predQueries[predIndex], walks, nestedId);
+            nestedIds.push_back(nestedId);
+          }
+          if (isTooDeep) {
+            abandonCalleeSummaries(walks);
             break;
           }
+          if (startedNested) {
+            continue;
+          }
+          walk.worklist.pop_back();
+          if (!areComplete(nestedIds)) {
+            summary.isComplete = false;
+            summary.inProgress = false;
+            walks.pop_back();
+            continue;
+          }
+          Node* callNode = n->getPredecessorBypassingFunctionCall();
+          for (unsigned nestedId : nestedIds) {
+            summary.nestedSummaries.push_back(nestedId);
+            for (QueryID entryQuery : summaries[nestedId].entryQueries) {
+              next.push_back(std::make_pair(callNode, entryQuery));
+            }
+          }
+        }
+        else {
+          walk.worklist.pop_back();
+          for (unsigned predIndex = 0; predIndex < preds.size(); ++predIndex) {
+            next.push_back(std::make_pair(preds[predIndex], predQueries[predIndex]));
+          }
+        }
+
+        for (std::pair<Node*, QueryID>& item : next) {
+          if (walk.seen.insert(std::make_pair(item.first->id, item.second)).second) {
+            summary.visitedQueries.push_back(std::make_pair(item.first->id, item.second));
+            walk.worklist.push_back(item);
+          }
+        }
+      }
+      return summaryId;
+    }
+
+    // Sets summaryId to the summary for exitQuery at exitNode. If there is none yet, creates it in an
+    // abandoned slot if there is one, pushes its walk onto walks, and returns true.
+    bool startCalleeSummary(Node* exitNode, QueryID exitQuery, std::vector<SummaryWalk>& walks, unsigned& summaryId) {
+      std::vector<CalleeSummary>& summaries = calleeSummaries->summaries;
+      std::vector<unsigned>& abandoned = calleeSummaries->abandonedSummaries;
+      unsigned slot = abandoned.empty() ? (unsigned)summaries.size() : abandoned.back();
+      std::pair<DenseMap<std::pair<unsigned, QueryID>, unsigned>::iterator, bool> inserted =
+        calleeSummaries->summaryForExit.insert(std::make_pair(std::make_pair(exitNode->id, exitQuery), slot));
+      summaryId = inserted.first->second;
+      if (!inserted.second) {
+        return false;
+      }
+      if (abandoned.empty()) {
+        summaries.push_back(CalleeSummary());
+      }
+      else {
+        abandoned.pop_back();
+        summaries[summaryId] = CalleeSummary();
+      }
+      summaries[summaryId].visitedQueries.push_back(std::make_pair(exitNode->id, exitQuery));
+
+      walks.push_back(SummaryWalk());
+      walks.back().summaryId = summaryId;
+      walks.back().exit = std::make_pair(exitNode->id, exitQuery);
+      walks.back().seen.insert(std::make_pair(exitNode->id, exitQuery));
+      walks.back().worklist.push_back(std::make_pair(exitNode, exitQuery));
+      return true;
+    }
+
+    // Drops the summaries of walks cut off by a budget from the cache and leaves them incomplete.
+    // Caching them would hand this branch's budget to every later branch that reaches the same exit.
+    // No summary nests them, since the walks that reached them are abandoned too, so their slots go
+    // to the next summaries started.
+    void abandonCalleeSummaries(std::vector<SummaryWalk>& walks) {
+      for (SummaryWalk& walk : walks) {
+        calleeSummaries->summaryForExit.erase(walk.exit);
+        CalleeSummary& summary = calleeSummaries->summaries[walk.summaryId];
+        summary = CalleeSummary();
+        summary.isComplete = false;
+        summary.inProgress = false;
+        calleeSummaries->abandonedSummaries.push_back(walk.summaryId);
+      }
+      walks.clear();
+    }
+
+    bool isComplete(unsigned summaryId) {
+      const CalleeSummary& summary = calleeSummaries->summaries[summaryId];
+      return !summary.inProgress && summary.isComplete;
+    }
+
+    bool areComplete(const std::vector<unsigned>& summaryIds) {
+      for (unsigned summaryId : summaryIds) {
+        if (!isComplete(summaryId)) {
+          return false;
         }
       }
+      return true;
     }
 
-    Query substitute(Node& basicBlock, Query q, std::map<Node*, Query>& querySubstitutedToPreds) {
-      return getSubstitutedQueries(basicBlock, q, querySubstitutedToPreds).back();
+    // Applies a summary's visited and resolved queries to this branch's tables, once per branch.
+    // Nested summaries are replayed depth first from an explicit stack, each one before those it nests.
+    void replayCalleeSummary(unsigned summaryId) {
+      if (summaryReplayed.size() <= summaryId) {
+        summaryReplayed.resize(calleeSummaries->summaries.size(), false);
+      }
+
+      std::vector<unsigned> stack(1, summaryId);
+      while (!stack.empty()) {
+        unsigned nextId = stack.back();
+        stack.pop_back();
+        if (summaryReplayed[nextId]) {
+          continue;
+        }
+        summaryReplayed[nextId] = true;
+        replayedSummaries.push_back(nextId);
+
+        const CalleeSummary& summary = calleeSummaries->summaries[nextId];
+        for (const std::pair<unsigned, QueryID>& visitedQuery : summary.visitedQueries) {
+          markVisited(graph->getNode(visitedQuery.first), visitedQuery.second);
+        }
+        for (const std::tuple<unsigned, QueryID, QueryResolution>& resolvedQuery : summary.resolvedQueries) {
+          Node* n = graph->getNode(std::get<0>(resolvedQuery));
+          markTouched(n);
+          queriesResolvedInNode[n->id].insert(std::get<1>(resolvedQuery));
+          queryResolutions[n->id][std::get<1>(resolvedQuery)].insert(std::make_pair(std::get<2>(resolvedQuery), EmptyContext));
+        }
+        stack.insert(stack.end(), summary.nestedSummaries.rbegin(), summary.nestedSummaries.rend());
+      }
+    }
+
+    const ResolutionSet& getResolutions(QueryID query, Node* n) {
+      static const ResolutionSet noResolutions;
+      std::map<QueryID, ResolutionSet>::const_iterator resolutionIter = queryResolutions[n->id].find(query);
+      return resolutionIter == queryResolutions[n->id].end() ? noResolutions : resolutionIter->second;
+    }
+
+    // Memoized resolve() of query in n.
+    bool resolve(Node& n, QueryID query, QueryResolution& resolution) {
+      TransferFunction<QueryResolution>& transfer = transferFunctions->get(n.id, query);
+      if (!transfer.hasResolution) {
+        transfer.isResolved = resolve(n, queries->get(query), transfer.resolution);
+        transfer.hasResolution = true;
+      }
+      resolution = transfer.resolution;
+      return transfer.isResolved;
+    }
+
+    // Query at the top of n after substituting query through it.
+    QueryID substitute(Node& n, QueryID query) {
+      return getSubstitution(n, query).substitutedQuery;
+    }
+
+    // Substitutes every query of result's present and end sets through the source node of its edge,
+    // which are all the renamings a def-use walk over result needs. The walks then find them in the
+    // transfer functions without adding to the state, which walks on other threads may be reading.
+    void substituteSetQueries(const InfeasiblePathResult& result) {
+      for (const auto& edge : result.presentSet) {
+        for (const std::tuple<QueryID, QueryResolution, CallContext>& element : edge.second) {
+          substitute(*edge.first.first, std::get<0>(element));
+        }
+      }
+      for (const auto& edge : result.endSet) {
+        for (const std::tuple<QueryID, QueryResolution, CallContext>& element : edge.second) {
+          substitute(*edge.first.first, std::get<0>(element));
+        }
+      }
     }
 
-    std::vector<Query> getSubstitutedQueries(Node& basicBlock, Query q, std::map<Node*, Query>& querySubstitutedToPreds) {
-      std::vector<Query> substituedQueries;
+    // Query handed to each of n's predecessors, aligned with n.getPredecessors().
+    ArrayRef<QueryID> substituteToPredecessors(Node& n, QueryID query) {
+      return getSubstitution(n, query).predecessorQueries;
+    }
+
+    const TransferFunction<QueryResolution>& getSubstitution(Node& n, QueryID query) {
+      TransferFunction<QueryResolution>& transfer = transferFunctions->get(n.id, query);
+      if (!transfer.hasSubstitution) {
+        SmallDenseMap<Node*, Query, 4> substitutedQueries;
+        Query substituted = getSubstitutedQueries(n, queries->get(query), substitutedQueries).back();
+        transfer.substitutedQuery = queries->intern(substituted);
+        for (Node* pred : n.getPredecessors()) {
+          transfer.predecessorQueries.push_back(queries->intern(substitutedQueries[pred]));
+        }
+        transfer.hasSubstitution = true;
+      }
+      return transfer;
+    }
+
+    SmallVector<Query, 4> getSubstitutedQueries(Node& basicBlock, Query q, SmallDenseMap<Node*, Query, 4>& querySubstitutedToPreds) {
+      SmallVector<Query, 4> substituedQueries;
       substituedQueries.push_back(q);
       for (Instruction* iIter : basicBlock.getReversedInstructions()) {
         Instruction& i = *iIter;
@@ -928,7 +1570,7 @@ namespace {
       q.lhs = n->getBranchCondition();
       q.queryOperator = IsTrue;
       q.rhs = nullptr;
-      std::map<Node*, Query> temp;
+      SmallDenseMap<Node*, Query, 4> temp;
 
 
       APInt value;
@@ -980,4 +1622,6 @@ namespace {
   };
 }
 
+#undef DEBUG_TYPE
+
 #endif
@@ -0,0 +1,5 @@
+#include "Node.h"
+
+#define DEBUG_TYPE "icfg"
+
+Statistic NumNodes = {DEBUG_TYPE, "NumNodes", "ICFG nodes created"};
@@ -1,5 +1,6 @@
 #ifndef NODE_H_
 #define NODE_H_
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/SmallPtrSet.h"
@@ -11,45 +12,90 @@
 #include "llvm/IR/Dominators.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Support/Allocator.h"
 
+#include "CallSiteIndex.h"
+
+#include <algorithm>
+#include <map>
 #include <vector>
 
 using namespace llvm;
 
+// ICFG nodes created. Defined once in Node.cpp, so every file including this header counts into the
+// same statistic.
+extern Statistic NumNodes;
 
+struct Node;
 
-Instruction* findFunctionCallTopDown(BasicBlock* b) {
-  for(Instruction& i : *b) {
-    if (i.getOpcode() == Instruction::Call) {
-      CallInst* callInst = dyn_cast<CallInst>(&i);
-      Function* f = callInst->getCalledFunction();
-      if (f != nullptr && !f->isDeclaration()) {
-        return &i;
-      }
-    }
-  }
-  return nullptr;
-}
+// Interprocedural CFG shared by every detector and def-use query run over a module. Every
+// (basic block, program point) node is created once, allocated out of a bump allocator and
+// lives as long as the graph does.
+//
+// Nodes are numbered densely in module order, and once the graph is built its edges are stored
+// in compressed sparse row form indexed by those IDs, so detectors can key their side tables
+// on Node::id and always walk neighbours in the same order. Nothing is modified after construction,
+// so any number of threads may walk the same graph concurrently.
+class ICFG {
+public:
+  explicit ICFG(Module& m);
 
-struct Node {
+  ICFG(const ICFG&) = delete;
+  ICFG& operator=(const ICFG&) = delete;
+
+  Node* getNode(BasicBlock* bb, Instruction* programPoint) const;
+  Node* getNode(unsigned id) const { return nodeList[id]; }
 
-  Node(BasicBlock* bb, Instruction* programPoint, std::map<std::pair<BasicBlock*, Instruction*>, Node*>* allNodes) : Node(bb, programPoint, false, allNodes) {
-    isEntryOfFunction = true;
+  // Returns the node whose instructions contain i.
+  Node* getNodeFor(BasicBlock* bb, Instruction* i) const;
+
+  Node* getFunctionEntryNode(Function* f) const;
+
+  ArrayRef<Node*> successorsOf(unsigned id) const {
+    return ArrayRef<Node*>(successorEdges.data() + successorOffsets[id], successorOffsets[id + 1] - successorOffsets[id]);
   }
 
-  Node(BasicBlock* bb, std::map<std::pair<BasicBlock*, Instruction*>, Node*>* allNodes, Node* returnPoint) : Node(bb, nullptr, false, allNodes) {
-    successors.insert(returnPoint);
-    successorsInitialized = true;
-    isExitOfFunction = true;
+  ArrayRef<Node*> predecessorsOf(unsigned id) const {
+    return ArrayRef<Node*>(predecessorEdges.data() + predecessorOffsets[id], predecessorOffsets[id + 1] - predecessorOffsets[id]);
   }
 
-  Node(BasicBlock* bb, Instruction* programPoint, bool isStartingNode, std::map<std::pair<BasicBlock*, Instruction*>, Node*>* allNodes) : 
-        basicBlock(bb), isExitOfFunction(false), isEntryOfFunction(false), successors(), predecessors(),
-        instructionsReversed(), successorsInitialized(false), predecessorsInitialized(false)
+  Module& getModule() const { return *module; }
+  const CallSiteIndex& getCallSites() const { return callSites; }
+  unsigned size() const { return nodeList.size(); }
+
+private:
+  friend struct Node;
+
+  Module* module;
+  CallSiteIndex callSites;
+  SpecificBumpPtrAllocator<Node> allocator;
+  std::map<std::pair<BasicBlock*, Instruction*>, Node*> nodes;
+  std::vector<Node*> nodeList;
+
+  std::vector<unsigned> successorOffsets;
+  std::vector<Node*> successorEdges;
+  std::vector<unsigned> predecessorOffsets;
+  std::vector<Node*> predecessorEdges;
+
+  // Edges discovered while building, as (from, to) node IDs.
+  std::vector<std::pair<unsigned, unsigned>> pendingEdges;
+
+  Node* getOrCreateNode(BasicBlock* bb, Instruction* programPoint);
+  void addEdge(Node* from, Node* to);
+  void build();
+  void buildAdjacency();
+};
+
+struct Node {
+
+  Node(BasicBlock* bb, Instruction* programPoint, unsigned id, ICFG* graph) : 
+        id(id), basicBlock(bb), isExitOfFunction(false), isEntryOfFunction(false),
+        instructionsReversed(), trueEdge(nullptr), falseEdge(nullptr), graph(graph)
          {
-    if (programPoint != nullptr && !isFunctionCall(programPoint) ) {
+    const CallSiteIndex& callSites = graph->getCallSites();
+    if (programPoint != nullptr && !callSites.isDefinedCall(programPoint) ) {
       // Determine function call to use as program point
-      programPointInBlock = findFunctionCallPriorToInstruction(basicBlock, programPoint);
+      programPointInBlock = callSites.getCallFollowing(programPoint);
     }
     else {
       programPointInBlock = programPoint;
@@ -57,59 +103,31 @@ struct Node {
     populateInstructionList();
     isEntryOfFunction = checkIfEntryOfFunction();
     isExitOfFunction = checkIfExitOfFunction();
-
-    this->isStartingNode = isStartingNode;
-    if (isStartingNode) {
-      this->allNodes = new std::map<std::pair<BasicBlock*, Instruction*>, Node*>();
-      (*(this->allNodes))[std::make_pair(bb, programPoint)] = this;
-    }
-    else {
-      this->allNodes = allNodes;
-    }
-  }
-
-  Node(BasicBlock* bb, Instruction* programPoint) : Node(bb, programPoint, true, nullptr)
-  {   
-  }
-
-  ~Node() {
-    if (isStartingNode) {
-      for(std::pair<std::pair<BasicBlock*, Instruction*>, Node*> node : *allNodes) {
-        if (node.second != this) {
-          delete node.second;
-        }
-      }
-      delete allNodes;
-    }
   }
 
+  unsigned id;
   BasicBlock* basicBlock;
   Instruction* programPointInBlock;
   bool isExitOfFunction;
   bool isEntryOfFunction;
 
-  Node* getFunctionEntryNode() {
-    BasicBlock* entryBlock = &(basicBlock->getParent()->getEntryBlock());
-    return getOrCreateNode(entryBlock, findFunctionCallTopDown(entryBlock));
+  ICFG& getGraph() const {
+    return *graph;
   }
 
-  const std::set<Node*>& getSuccessors() {
-    if (!successorsInitialized) {
-      populateSuccessors();
-      successorsInitialized = true;
-    }
-    return successors;
+  Node* getFunctionEntryNode() const {
+    return graph->getFunctionEntryNode(basicBlock->getParent());
   }
 
-  const std::set<Node*>& getPredecessors() {
-    if (!predecessorsInitialized) {
-      populatePredecessors();
-      predecessorsInitialized = true;
-    }
-    return predecessors;
+  ArrayRef<Node*> getSuccessors() const {
+    return graph->successorsOf(id);
+  }
+
+  ArrayRef<Node*> getPredecessors() const {
+    return graph->predecessorsOf(id);
   }
 
-  const std::vector<Instruction*>& getReversedInstructions() {
+  const std::vector<Instruction*>& getReversedInstructions() const {
     return instructionsReversed;
   }
 
@@ -128,329 +146,204 @@ struct Node {
     }
   }
 
-  Node* getTrueEdge() {
-    const TerminatorInst* terminator = basicBlock->getTerminator();
-    BasicBlock* trueDestination = dyn_cast<BasicBlock>(terminator->getOperand(2));
-    Instruction* i = findFunctionCallTopDown(trueDestination);
-
-    if (!successorsInitialized) {
-      populateSuccessors();
-      successorsInitialized = true;
-    }
-    return getOrCreateNode(trueDestination, i);
-  }
-
-  Node* getFalseEdge() {
-    const TerminatorInst* terminator = basicBlock->getTerminator();
-    BasicBlock* falseDestination = dyn_cast<BasicBlock>(terminator->getOperand(1));
-    Instruction* i = findFunctionCallTopDown(falseDestination);
-
-    if (!successorsInitialized) {
-      populateSuccessors();
-      successorsInitialized = true;
-    }
-    return getOrCreateNode(falseDestination, i);
-  }
-
-  Node* getNodeFor(BasicBlock* bb, Instruction* i) {
-    Instruction* startInstruction = findFunctionCallPriorToInstruction(bb, i);
-    return getOrCreateNode(bb, startInstruction);
+  Node* getTrueEdge() const {
+    return trueEdge;
   }
 
-  void addPredecessor(Node* node) {
-    predecessorsInitialized = true;
-    predecessors.insert(node);
+  Node* getFalseEdge() const {
+    return falseEdge;
   }
 
-  void addSuccessor(Node* node) {
-    successorsInitialized = true;
-    successors.insert(node);
-  }
-
-  Node* getPredecessorBypassingFunctionCall() {
+  Node* getPredecessorBypassingFunctionCall() const {
     Instruction* callSite = instructionsReversed.back();
 
-    return getOrCreateNode(basicBlock, callSite);
+    return graph->getNode(basicBlock, callSite);
   }
 
 private:
-  std::set<Node*> successors;
-  std::set<Node*> predecessors;
-  std::vector<Instruction*> instructionsReversed;
-  bool successorsInitialized;
-  bool predecessorsInitialized;
-  bool isStartingNode;
-  std::map<std::pair<BasicBlock*, Instruction*>, Node*>* allNodes;
-  //std::set<Node*> callSites;
-
+  friend class ICFG;
 
-  bool isFunctionCall(Instruction* i) {
-    if (i == nullptr || i->getOpcode() != Instruction::Call) {
-      return false;
-    }
-    CallInst* callInst = dyn_cast<CallInst>(i);
-    Function* f = callInst->getCalledFunction();
-    if (f == nullptr || f->isDeclaration()) {
-      return false;
+  std::vector<Instruction*> instructionsReversed;
+  // Branch destinations, resolved once when the graph is built.
+  Node* trueEdge;
+  Node* falseEdge;
+  ICFG* graph;
+
+  // Defined function call at the top of this node's instructions, if the node starts right after one.
+  Instruction* getCallAtTop() const {
+    const CallSiteIndex& callSites = graph->getCallSites();
+    if (programPointInBlock == nullptr) {
+      return callSites.getLastCallIn(basicBlock);
     }
-    return true;
+    return callSites.getPreviousCallBefore(programPointInBlock);
   }
 
   void populatePredecessors() {
-    bool functionFound = false;
-    if (programPointInBlock == nullptr) {
-      for (BasicBlock::reverse_iterator iIter = basicBlock->rbegin(); iIter != basicBlock->rend(); ++iIter) {
-        Instruction& i = *iIter;
-        if (i.getOpcode() == Instruction::Call) {
-          CallInst* callInst = dyn_cast<CallInst>(&i);
-          Function* f = callInst->getCalledFunction();
-          if (f != nullptr && !f->isDeclaration()) {
-            functionFound = true;
-            addFunctionExitBlocksToPredecessors(*f, callInst);
-            Node* callSite = getOrCreateNode(basicBlock, &i);
-            createFunctionEntryNode(f, callSite);
-            break;
-          }
-        }
-      }
-    }
-    else {
-      bool programPointReached = false;
-      for (BasicBlock::reverse_iterator iIter = basicBlock->rbegin(); iIter != basicBlock->rend(); ++iIter) {
-        Instruction& i = *iIter;
-        if (!programPointReached) {
-          if (&i == programPointInBlock) {
-            programPointReached = true;  
-          }
-          continue;
-        }
-
-        if (i.getOpcode() == Instruction::Call) {
-          CallInst* callInst = dyn_cast<CallInst>(&i);
-          Function* f = callInst->getCalledFunction();
-          if (f != nullptr && !f->isDeclaration()) {
-            functionFound = true;
-            addFunctionExitBlocksToPredecessors(*f, callInst);
-            Node* callSite = getOrCreateNode(basicBlock, &i);
-            createFunctionEntryNode(f, callSite);
-            break;
-          }
-        }
+    const CallSiteIndex& callSites = graph->getCallSites();
+    Instruction* callAtTop = getCallAtTop();
+    if (callAtTop != nullptr) {
+      Function* f = dyn_cast<CallInst>(callAtTop)->getCalledFunction();
+      for (BasicBlock* exitBlock : callSites.getExitBlocksOf(f)) {
+        addPredecessor(exitBlock, nullptr);
       }
+      return;
     }
 
-    if (!functionFound) {
-      for(BasicBlock* pred : llvm::predecessors(basicBlock)) {
-        addPredecessor(pred, nullptr);
-      }
-      // means this is the entry node of the function
-      if (predecessors.size() == 0) {
-        Function* f = basicBlock->getParent();
-        // get call sites of function
-        for(User *u : f->users()) {
-          if (isa<CallInst>(u)) {
-            CallInst* callInst = dyn_cast<CallInst>(u);
-            BasicBlock* callSiteBlock = callInst->getParent();
-            addPredecessor(callSiteBlock, callInst);
-            Node* callSite = getOrCreateNode(callSiteBlock, callInst);
-            callSite->addSuccessor(this);
-          }
-        }
+    bool hasPredecessors = false;
+    for(BasicBlock* pred : llvm::predecessors(basicBlock)) {
+      addPredecessor(pred, nullptr);
+      hasPredecessors = true;
+    }
+    // means this is the entry node of the function
+    if (!hasPredecessors) {
+      for (CallInst* callInst : callSites.getCallSitesOf(basicBlock->getParent())) {
+        addPredecessor(callInst->getParent(), callInst);
       }
     }
   }
 
   void populateSuccessors() {
-    
+    const CallSiteIndex& callSites = graph->getCallSites();
     if (programPointInBlock == nullptr) {
       for(BasicBlock* succ : llvm::successors(basicBlock)) {
-        addSuccessor(succ, findFunctionCallTopDown(succ));
+        addSuccessor(succ, callSites.getFirstCallIn(succ));
       }
     }
     else {
-      for (Instruction& i : *basicBlock) {
-        if (&i == programPointInBlock) {
-          CallInst* callInst = dyn_cast<CallInst>(&i);
-          Function* f = callInst->getCalledFunction();
-          Node* entryNode = createFunctionEntryNode(f, this);
-          addSuccessor(entryNode);
-
-          Instruction* nextFunctionCall = findNextFunctionCallAfter(basicBlock, programPointInBlock);
-          Node* returnToPoint = getOrCreateNode(basicBlock, nextFunctionCall);
-          createFunctionExitNodes(returnToPoint, f);
-          break;
-        }
+      Function* f = dyn_cast<CallInst>(programPointInBlock)->getCalledFunction();
+      BasicBlock* entryBlock = &(f->getEntryBlock());
+      addSuccessor(entryBlock, callSites.getFirstCallIn(entryBlock));
+
+      Node* returnToPoint = graph->getOrCreateNode(basicBlock, callSites.getNextCallAfter(programPointInBlock));
+      for (BasicBlock* exitBlock : callSites.getExitBlocksOf(f)) {
+        graph->addEdge(graph->getOrCreateNode(exitBlock, nullptr), returnToPoint);
       }
     }
+
+    if (endsWithConditionalBranch()) {
+      const TerminatorInst* terminator = basicBlock->getTerminator();
+      BasicBlock* trueDestination = dyn_cast<BasicBlock>(terminator->getOperand(2));
+      BasicBlock* falseDestination = dyn_cast<BasicBlock>(terminator->getOperand(1));
+      trueEdge = graph->getOrCreateNode(trueDestination, callSites.getFirstCallIn(trueDestination));
+      falseEdge = graph->getOrCreateNode(falseDestination, callSites.getFirstCallIn(falseDestination));
+    }
   }
 
+  // Collects the instructions between the call at the top of this node (inclusive) and its
+  // program point (exclusive), last instruction first.
   void populateInstructionList() {
-    if (programPointInBlock == nullptr) {
-      for (BasicBlock::reverse_iterator iIter = basicBlock->rbegin(); iIter != basicBlock->rend(); ++iIter) {
-        Instruction& i = *iIter;
-        instructionsReversed.push_back(&i);
-        if (i.getOpcode() == Instruction::Call) {
-          CallInst* callInst = dyn_cast<CallInst>(&i);
-          Function* f = callInst->getCalledFunction();
-          if (f != nullptr && !f->isDeclaration()) {
-            break;
-          }
-        }
-      }
-    }
-    else {
-      bool programPointReached = false;
-      for (BasicBlock::reverse_iterator iIter = basicBlock->rbegin(); iIter != basicBlock->rend(); ++iIter) {
-        Instruction& i = *iIter;
-        if (!programPointReached) {
-          if (&i == programPointInBlock) {
-            programPointReached = true;  
-            //instructionsReversed.push_back(&i);
-          }
-          continue;
-        }
-
-        instructionsReversed.push_back(&i);
-        if (i.getOpcode() == Instruction::Call) {
-          CallInst* callInst = dyn_cast<CallInst>(&i);
-          Function* f = callInst->getCalledFunction();
-          if (f != nullptr && !f->isDeclaration()) {
-            break;
-          }
-        }
-      }
+    BasicBlock::iterator end = (programPointInBlock == nullptr) ? basicBlock->end() : programPointInBlock->getIterator();
+    Instruction* callAtTop = getCallAtTop();
+    BasicBlock::iterator begin = (callAtTop == nullptr) ? basicBlock->begin() : callAtTop->getIterator();
+    while (end != begin) {
+      --end;
+      instructionsReversed.push_back(&(*end));
     }
   }
 
   void addPredecessor(BasicBlock* bb, Instruction* i) {
-    Node* n = getOrCreateNode(bb, i);
-    predecessors.insert(n);
+    graph->addEdge(graph->getOrCreateNode(bb, i), this);
   }
 
   void addSuccessor(BasicBlock* bb, Instruction* i) {
-    successors.insert(getOrCreateNode(bb, i));
+    graph->addEdge(this, graph->getOrCreateNode(bb, i));
   }
 
-  Node* getOrCreateNode(BasicBlock* bb, Instruction* i) {
-    Node* node;
-    if (allNodes->count(std::make_pair(bb, i)) > 0) {
-      node = (*allNodes)[std::make_pair(bb, i)];
-      if (node == nullptr) {
-        node = new Node(bb, i, false, allNodes);
-        (*allNodes)[std::make_pair(bb, nullptr)] = node;
-      }
-    }
-    else {
-      node = new Node(bb, i, false, allNodes);
-      (*allNodes)[std::make_pair(bb, i)] = node;
-    }
-    return node;
+  bool checkIfEntryOfFunction() const {
+    BasicBlock* entryBlock = &(basicBlock->getParent()->getEntryBlock());
+    return basicBlock == entryBlock && programPointInBlock == graph->getCallSites().getFirstCallIn(entryBlock);
   }
 
-  void addFunctionExitBlocksToPredecessors(Function& f, Instruction* callInstruction) {
-    for(BasicBlock& b : f) {
-      if (b.getTerminator()->getNumSuccessors() == 0) {
-        Node* n = createFunctionExitNode(&b, this);
-        addPredecessor(n);
-      }
-    }
+  bool checkIfExitOfFunction() const {
+    return programPointInBlock == nullptr && basicBlock->getTerminator()->getNumSuccessors() == 0;
   }
 
-  void createNodesForFunctionCall(Node* callSite, Node* returnToPoint, Function* f) {
-    createFunctionExitNodes(returnToPoint, f);
-    createFunctionEntryNode(f, callSite);
-  }
+};
 
-  void createFunctionExitNodes(Node* returnToPoint, Function* f) {
-    for(BasicBlock& b : *f) {
-      if (b.getTerminator()->getNumSuccessors() == 0) {
-        createFunctionExitNode(&b, returnToPoint);
-      }
-    }
-  }
+inline ICFG::ICFG(Module& m) : module(&m), callSites(m) {
+  build();
+}
 
-  Node* createFunctionExitNode(BasicBlock* bb, Node* returnToPoint) {
-    Node* node;
-    if (allNodes->count(std::make_pair(bb, nullptr)) > 0) {
-      node = (*allNodes)[std::make_pair(bb, nullptr)];
-      if (node == nullptr) {
-        node = new Node(bb, allNodes, returnToPoint);
-        (*allNodes)[std::make_pair(bb, nullptr)] = node;
-      }
-      node->addSuccessor(returnToPoint);
-    }
-    else {
-      node = new Node(bb, allNodes, returnToPoint);
-      (*allNodes)[std::make_pair(bb, nullptr)] = node;
-    }
-    return node;
+inline Node* ICFG::getOrCreateNode(BasicBlock* bb, Instruction* i) {
+  std::map<std::pair<BasicBlock*, Instruction*>, Node*>::iterator nodeIter = nodes.find(std::make_pair(bb, i));
+  if (nodeIter != nodes.end()) {
+    return nodeIter->second;
   }
+  Node* node = new (allocator.Allocate()) Node(bb, i, nodeList.size(), this);
+  nodes[std::make_pair(bb, i)] = node;
+  nodeList.push_back(node);
+  ++NumNodes;
+  return node;
+}
 
-  Node* createFunctionEntryNode(Function* f, Node* callSite) {
-    Node* node;
-    BasicBlock* bb = &(f->getEntryBlock());
-    Instruction* i = findFunctionCallTopDown(bb);
-    if (allNodes->count(std::make_pair(bb, i)) > 0) {
-      node = (*allNodes)[std::make_pair(bb, i)];
-      if (node == nullptr) {
-        node = new Node(bb, i, allNodes);
-        (*allNodes)[std::make_pair(bb, i)] = node;  
-      }
-    }
-    else {
-      node = new Node(bb, i, allNodes);
-      (*allNodes)[std::make_pair(bb, i)] = node;
-    }
-    return node;
-  }
+inline Node* ICFG::getNode(BasicBlock* bb, Instruction* i) const {
+  std::map<std::pair<BasicBlock*, Instruction*>, Node*>::const_iterator nodeIter = nodes.find(std::make_pair(bb, i));
+  assert(nodeIter != nodes.end() && "node requested outside of the built ICFG");
+  return nodeIter->second;
+}
 
-  Instruction* findNextFunctionCallAfter(BasicBlock* bb, Instruction* toFind) {
-    bool programPointFound = toFind == nullptr;
-    for(Instruction& i : *bb) {
-      if (!programPointFound) {
-        if (&i == toFind) {
-          programPointFound = true;
-        }
-        continue;
-      }
+inline Node* ICFG::getNodeFor(BasicBlock* bb, Instruction* i) const {
+  return getNode(bb, callSites.getCallFollowing(i));
+}
+
+inline Node* ICFG::getFunctionEntryNode(Function* f) const {
+  BasicBlock* bb = &(f->getEntryBlock());
+  return getNode(bb, callSites.getFirstCallIn(bb));
+}
+
+inline void ICFG::addEdge(Node* from, Node* to) {
+  pendingEdges.push_back(std::make_pair(from->id, to->id));
+}
 
-      if (i.getOpcode() == Instruction::Call) {
-        CallInst* callInst = dyn_cast<CallInst>(&i);
-        Function* f = callInst->getCalledFunction();
-        if (f != nullptr && !f->isDeclaration()) {
-          return &i;
-        }
+// Creates a node for every call-delimited segment of every defined function and wires up all of
+// their edges, so detectors never have to grow the graph while walking it.
+inline void ICFG::build() {
+  for (Function& f : *module) {
+    if (f.isDeclaration()) {
+      continue;
+    }
+    for (BasicBlock& b : f) {
+      for (Instruction* call : callSites.getCallsIn(&b)) {
+        getOrCreateNode(&b, call);
       }
+      getOrCreateNode(&b, nullptr);
     }
-    return nullptr;
   }
 
-  bool checkIfEntryOfFunction() {
-    BasicBlock* entryBlock = &(basicBlock->getParent()->getEntryBlock());
-    Instruction* i = findFunctionCallTopDown(entryBlock);
-    return basicBlock == entryBlock && programPointInBlock == i;
+  for (size_t i = 0; i < nodeList.size(); ++i) {
+    nodeList[i]->populateSuccessors();
+    nodeList[i]->populatePredecessors();
   }
+  buildAdjacency();
+}
 
-  bool checkIfExitOfFunction() {
-    return programPointInBlock == nullptr && basicBlock->getTerminator()->getNumSuccessors() == 0;
-  }
+inline void ICFG::buildAdjacency() {
+  std::sort(pendingEdges.begin(), pendingEdges.end());
+  pendingEdges.erase(std::unique(pendingEdges.begin(), pendingEdges.end()), pendingEdges.end());
 
-  Instruction* findFunctionCallPriorToInstruction(BasicBlock* bb, Instruction* i) {
-    Instruction* programPointToUse = nullptr;
-    for (BasicBlock::reverse_iterator iIter = bb->rbegin(); iIter != bb->rend(); ++iIter) {
-      Instruction& inst = *iIter;
-      if (&inst == i) {
-        break;
-      }
+  successorOffsets.assign(nodeList.size() + 1, 0);
+  predecessorOffsets.assign(nodeList.size() + 1, 0);
+  for (const std::pair<unsigned, unsigned>& edge : pendingEdges) {
+    ++successorOffsets[edge.first + 1];
+    ++predecessorOffsets[edge.second + 1];
+  }
+  for (size_t i = 1; i < successorOffsets.size(); ++i) {
+    successorOffsets[i] += successorOffsets[i - 1];
+    predecessorOffsets[i] += predecessorOffsets[i - 1];
+  }
 
-      if (isFunctionCall(&inst)) {
-        programPointToUse = &inst;
-      }
-    }
-    return programPointToUse;
+  // Edges are sorted by source, so successors can be laid out in order. Predecessors are filled
+  // through a cursor per node and end up ordered by source ID as well.
+  successorEdges.resize(pendingEdges.size());
+  predecessorEdges.resize(pendingEdges.size());
+  std::vector<unsigned> predecessorCursor(predecessorOffsets.begin(), predecessorOffsets.end() - 1);
+  for (size_t i = 0; i < pendingEdges.size(); ++i) {
+    successorEdges[i] = nodeList[pendingEdges[i].second];
+    predecessorEdges[predecessorCursor[pendingEdges[i].second]++] = nodeList[pendingEdges[i].first];
   }
 
-};
+  std::vector<std::pair<unsigned, unsigned>>().swap(pendingEdges);
+}
 
 
 #endif
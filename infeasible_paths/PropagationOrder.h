@@ -0,0 +1,115 @@
+#ifndef PROPAGATIONORDER_H_
+#define PROPAGATIONORDER_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// Order in which a worklist should take the nodes of a graph when it propagates facts forward
+// until they stop changing. Strongly connected components come in topological order, so a
+// component is only worked on once everything flowing into it has settled, and the nodes inside
+// a component come in reverse postorder, so each pass over a loop sees a node after its
+// predecessors outside the back edges. Nodes are numbered 0..n-1 by the caller.
+class PropagationOrder {
+public:
+  // Ranks the nodes of a graph with the given successor lists. Lower ranks come first.
+  void compute(const std::vector<std::vector<unsigned>>& successors) {
+    unsigned numberOfNodes = successors.size();
+    std::vector<unsigned> component(numberOfNodes);
+    std::vector<unsigned> postorder(numberOfNodes);
+    unsigned numberOfComponents = findComponents(successors, component, postorder);
+
+    // Tarjan's algorithm closes a component only after every component it reaches, so component
+    // numbers run in reverse topological order.
+    nodes.resize(numberOfNodes);
+    for (unsigned n = 0; n < numberOfNodes; ++n) {
+      nodes[n] = n;
+    }
+    std::sort(nodes.begin(), nodes.end(), [&](unsigned a, unsigned b) {
+      return std::make_pair(numberOfComponents - component[a], numberOfNodes - postorder[a]) <
+             std::make_pair(numberOfComponents - component[b], numberOfNodes - postorder[b]);
+    });
+    ranks.resize(numberOfNodes);
+    for (unsigned rank = 0; rank < numberOfNodes; ++rank) {
+      ranks[nodes[rank]] = rank;
+    }
+  }
+
+  unsigned getRank(unsigned node) const {
+    return ranks[node];
+  }
+
+  unsigned getNode(unsigned rank) const {
+    return nodes[rank];
+  }
+
+private:
+  std::vector<unsigned> ranks;
+  std::vector<unsigned> nodes;
+
+  // Index of a node the search has not reached yet
+  enum : unsigned { Unvisited = ~0u };
+
+  // Iterative Tarjan. Fills in each node's component and its postorder number in the depth-first
+  // search, and returns the number of components.
+  static unsigned findComponents(const std::vector<std::vector<unsigned>>& successors, std::vector<unsigned>& component,
+                                 std::vector<unsigned>& postorder) {
+    unsigned numberOfNodes = successors.size();
+    std::vector<unsigned> index(numberOfNodes, Unvisited);
+    std::vector<unsigned> lowLink(numberOfNodes);
+    std::vector<bool> onStack(numberOfNodes, false);
+    std::vector<unsigned> stack;
+    // Node being searched and the position of the next successor to look at.
+    std::vector<std::pair<unsigned, unsigned>> search;
+    unsigned nextIndex = 0;
+    unsigned nextPostorder = 0;
+    unsigned numberOfComponents = 0;
+
+    for (unsigned root = 0; root < numberOfNodes; ++root) {
+      if (index[root] != Unvisited) {
+        continue;
+      }
+      index[root] = lowLink[root] = nextIndex++;
+      stack.push_back(root);
+      onStack[root] = true;
+      search.push_back(std::make_pair(root, 0));
+
+      while (!search.empty()) {
+        unsigned n = search.back().first;
+        if (search.back().second < successors[n].size()) {
+          unsigned succ = successors[n][search.back().second++];
+          if (index[succ] == Unvisited) {
+            index[succ] = lowLink[succ] = nextIndex++;
+            stack.push_back(succ);
+            onStack[succ] = true;
+            search.push_back(std::make_pair(succ, 0));
+          }
+          else if (onStack[succ]) {
+            lowLink[n] = std::min(lowLink[n], index[succ]);
+          }
+          continue;
+        }
+
+        search.pop_back();
+        postorder[n] = nextPostorder++;
+        if (!search.empty()) {
+          unsigned parent = search.back().first;
+          lowLink[parent] = std::min(lowLink[parent], lowLink[n]);
+        }
+        if (lowLink[n] == index[n]) {
+          unsigned member;
+          do {
+            member = stack.back();
+            stack.pop_back();
+            onStack[member] = false;
+            component[member] = numberOfComponents;
+          } while (member != n);
+          ++numberOfComponents;
+        }
+      }
+    }
+    return numberOfComponents;
+  }
+};
+
+#endif
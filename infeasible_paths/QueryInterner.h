@@ -0,0 +1,81 @@
+#ifndef QUERYINTERNER_H_
+#define QUERYINTERNER_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Value.h"
+
+#include <vector>
+
+using namespace llvm;
+
+typedef unsigned QueryID;
+
+// The fields that identify a query: (lhs, operator, rhs, summary flag).
+struct QueryKey {
+  Value* lhs;
+  unsigned queryOperator;
+  ConstantInt* rhs;
+  bool isSummaryNodeQuery;
+
+  bool operator==(const QueryKey& other) const {
+    return lhs == other.lhs && queryOperator == other.queryOperator && rhs == other.rhs && isSummaryNodeQuery == other.isSummaryNodeQuery;
+  }
+};
+
+namespace llvm {
+  template <> struct DenseMapInfo<QueryKey> {
+    static QueryKey getEmptyKey() {
+      QueryKey key = { DenseMapInfo<Value*>::getEmptyKey(), 0, nullptr, false };
+      return key;
+    }
+
+    static QueryKey getTombstoneKey() {
+      QueryKey key = { DenseMapInfo<Value*>::getTombstoneKey(), 0, nullptr, false };
+      return key;
+    }
+
+    static unsigned getHashValue(const QueryKey& key) {
+      return hash_combine(key.lhs, key.queryOperator, key.rhs, key.isSummaryNodeQuery);
+    }
+
+    static bool isEqual(const QueryKey& lhs, const QueryKey& rhs) {
+      return lhs == rhs;
+    }
+  };
+}
+
+// Hash-conses queries so each distinct one is stored once and referred to by a dense QueryID.
+// Tables keyed on IDs compare and hash queries in constant time regardless of their layout.
+// QueryT must provide getKey().
+template <typename QueryT>
+class QueryInterner {
+public:
+  QueryInterner() {}
+
+  QueryInterner(const QueryInterner&) = delete;
+  QueryInterner& operator=(const QueryInterner&) = delete;
+
+  QueryID intern(const QueryT& query) {
+    std::pair<typename DenseMap<QueryKey, QueryID>::iterator, bool> inserted = ids.insert(std::make_pair(query.getKey(), (QueryID)queries.size()));
+    if (inserted.second) {
+      queries.push_back(query);
+    }
+    return inserted.first->second;
+  }
+
+  const QueryT& get(QueryID id) const {
+    return queries[id];
+  }
+
+  unsigned size() const {
+    return queries.size();
+  }
+
+private:
+  DenseMap<QueryKey, QueryID> ids;
+  std::vector<QueryT> queries;
+};
+
+#endif
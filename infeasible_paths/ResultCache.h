@@ -0,0 +1,797 @@
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "DefUseMap.h"
+#include "InterproceduralInfeasiblePathDetector.h"
+
+using namespace llvm;
+
+namespace {
+
+  // 64-bit FNV-1a.
+  class StructuralHash {
+  public:
+    StructuralHash() : hash(14695981039346656037ULL) {}
+
+    void add(uint64_t value) {
+      for (unsigned byte = 0; byte < 8; ++byte) {
+        hash ^= (value >> (byte * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+      }
+    }
+
+    void add(StringRef s) {
+      add(s.size());
+      for (char c : s) {
+        hash ^= (unsigned char)c;
+        hash *= 1099511628211ULL;
+      }
+    }
+
+    uint64_t get() const {
+      return hash;
+    }
+
+  private:
+    uint64_t hash;
+  };
+
+  // Results of an earlier run of the interprocedural analyses, kept in a file between runs so
+  // functions whose results cannot have changed are not analyzed again.
+  //
+  // Each entry holds one function's infeasible paths and def-use pairs, with the structural hash of
+  // every function its analysis read: the functions the detector's walks touched and the ones the
+  // def-use walks entered. An entry is only reused if all of them still hash the same. A function's
+  // hash covers its instructions and operands, the names the results are printed with, and the
+  // functions calling it, since those decide the predecessors of its entry node. Global variables
+  // it uses are hashed with their initializers, which queries reaching main's entry resolve on, and
+  // functions it calls with whether they have a body, which decides if the ICFG enters them. Blocks,
+  // instructions and ICFG nodes are stored by position within their function, and queries and
+  // calling contexts structurally, so entries can be decoded into any run's query state.
+  class ResultCache {
+  public:
+    ResultCache(Module& M, ICFG& graph) : module(&M), graph(&graph) {
+      // Globals named in an initializer are hashed by name only, so the hashes do not depend on the
+      // order the globals come in.
+      DenseMap<GlobalVariable*, uint64_t> initializerHashes;
+      for (GlobalVariable& G : M.globals()) {
+        initializerHashes[&G] = hashGlobal(G);
+      }
+      globalHashes.swap(initializerHashes);
+
+      for (Function& F : M) {
+        functionIndex[&F] = slots.size();
+        slots.push_back(Slot());
+        Slot& slot = slots.back();
+        slot.function = &F;
+        for (BasicBlock& B : F) {
+          blockIndex[&B] = slot.blocks.size();
+          slot.blocks.push_back(&B);
+          for (Instruction& I : B) {
+            instructionIndex[&I] = slot.instructions.size();
+            slot.instructions.push_back(&I);
+          }
+        }
+      }
+      for (Slot& slot : slots) {
+        slot.hash = hashFunction(*slot.function);
+      }
+    }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Maps the cache file an earlier run saved. A missing or malformed file leaves the cache empty.
+    void load(StringRef path) {
+      int fd;
+      if (sys::fs::openFileForRead(path, fd)) {
+        return;
+      }
+      uint64_t size;
+      std::error_code error = sys::fs::file_size(path, size);
+      if (!error && size > 0) {
+        mapping.reset(new sys::fs::mapped_file_region(fd, sys::fs::mapped_file_region::readonly, size, 0, error));
+      }
+      sys::Process::SafelyCloseFileDescriptor(fd);
+      if (error || !mapping) {
+        mapping.reset();
+        return;
+      }
+
+      ByteReader reader(StringRef(mapping->const_data(), mapping->size()));
+      if (reader.bytes(sizeof(Magic) - 1) != Magic || reader.u32() != Version) {
+        return;
+      }
+      unsigned numberOfEntries = reader.u32();
+      for (unsigned i = 0; i < numberOfEntries && reader.ok; ++i) {
+        StringRef entry = reader.bytes(reader.u32());
+        ByteReader entryReader(entry);
+        StringRef name = entryReader.string();
+        if (reader.ok && entryReader.ok) {
+          entries[name] = entry;
+        }
+      }
+    }
+
+    // Writes an entry for every function whose results were either reused or recorded in full.
+    bool save(StringRef path) const {
+      std::string file(Magic, sizeof(Magic) - 1);
+      ByteWriter writer(file);
+      writer.u32(Version);
+      std::vector<std::string> newEntries;
+      for (const Slot& slot : slots) {
+        if (slot.isReused) {
+          newEntries.push_back(slot.entry.str());
+        }
+        else if (slot.hasPaths && slot.hasDefUses && slot.encoder.ok) {
+          newEntries.push_back(encodeEntry(slot));
+        }
+      }
+      writer.u32(newEntries.size());
+      for (const std::string& entry : newEntries) {
+        writer.u32(entry.size());
+        file += entry;
+      }
+
+      // Written next to the old file and moved over it, which may still be mapped.
+      std::string temporaryPath = (path + ".tmp").str();
+      {
+        std::error_code error;
+        raw_fd_ostream out(temporaryPath, error, sys::fs::F_None);
+        if (error) {
+          return false;
+        }
+        out << file;
+        out.close();
+        if (out.has_error()) {
+          out.clear_error();
+          return false;
+        }
+      }
+      return !sys::fs::rename(temporaryPath, path);
+    }
+
+    // Decodes F's infeasible paths into state if its entry is still valid. Results are decoded in
+    // the order the branches were recorded.
+    bool lookupPaths(Function& F, ModuleQueryState& state, std::vector<Node*>& branchNodes, std::vector<InfeasiblePathResult>& results) {
+      Slot& slot = slots[functionIndex.lookup(&F)];
+      StringMap<StringRef>::const_iterator entry = entries.find(F.getName());
+      if (entry == entries.end()) {
+        return false;
+      }
+
+      ByteReader reader(entry->second);
+      reader.string();
+      std::vector<Function*> functions;
+      if (!readDependencies(reader, functions)) {
+        return false;
+      }
+
+      Decoder decoder(*this, reader, functions);
+      std::vector<QueryID> queries(reader.count());
+      for (QueryID& query : queries) {
+        Query q;
+        q.lhs = decoder.value();
+        q.queryOperator = (QueryOperator)reader.u8();
+        q.rhs = dyn_cast_or_null<ConstantInt>(decoder.value());
+        q.isSummaryNodeQuery = reader.u8() != 0;
+        query = state.queries.intern(q);
+      }
+      std::vector<CallContext> contexts(reader.count());
+      for (CallContext& context : contexts) {
+        std::vector<Node*> callSites(reader.count());
+        for (Node*& callSite : callSites) {
+          callSite = decoder.node();
+        }
+        context = EmptyContext;
+        for (std::vector<Node*>::reverse_iterator callSite = callSites.rbegin(); reader.ok && callSite != callSites.rend(); ++callSite) {
+          context = state.callStrings.push(context, *callSite);
+        }
+      }
+
+      branchNodes.assign(reader.count(), nullptr);
+      results.assign(branchNodes.size(), InfeasiblePathResult());
+      for (unsigned branch = 0; branch < branchNodes.size() && reader.ok; ++branch) {
+        branchNodes[branch] = decoder.node();
+        decoder.edgeSets(results[branch].startSet, queries, contexts);
+        decoder.edgeSets(results[branch].presentSet, queries, contexts);
+        decoder.edgeSets(results[branch].endSet, queries, contexts);
+      }
+      if (!reader.ok) {
+        branchNodes.clear();
+        results.clear();
+        return false;
+      }
+
+      slot.isReused = true;
+      slot.entry = entry->second;
+      slot.defUsesOffset = reader.offset;
+      return true;
+    }
+
+    // Decodes F's def-use pairs. Only valid for functions whose paths lookupPaths decoded.
+    bool lookupDefUses(Function& F, DefUseMap& defUses) const {
+      const Slot& slot = slots[functionIndex.lookup(&F)];
+      if (!slot.isReused) {
+        return false;
+      }
+
+      ByteReader reader(slot.entry);
+      reader.string();
+      std::vector<Function*> functions;
+      readDependencies(reader, functions);
+      reader.offset = slot.defUsesOffset;
+
+      Decoder decoder(*this, reader, functions);
+      unsigned numberOfVariables = reader.u32();
+      for (unsigned variable = 0; variable < numberOfVariables && reader.ok; ++variable) {
+        Value* v = decoder.value();
+        unsigned numberOfPairs = reader.u32();
+        for (unsigned pair = 0; pair < numberOfPairs && reader.ok; ++pair) {
+          BasicBlock* def = decoder.block();
+          BasicBlock* use = decoder.block();
+          if (reader.ok) {
+            defUses.insert(v, std::make_pair(def, use));
+          }
+        }
+      }
+      return reader.ok;
+    }
+
+    bool isReused(Function& F) const {
+      return slots[functionIndex.lookup(&F)].isReused;
+    }
+
+    // Encodes F's infeasible paths. dependencies are the functions the detector touched; queries
+    // and calling contexts are read from state.
+    void recordPaths(Function& F, const SmallPtrSetImpl<Function*>& dependencies, ArrayRef<Node*> branchNodes,
+                     ArrayRef<InfeasiblePathResult> results, const ModuleQueryState& state) {
+      Slot& slot = slots[functionIndex.lookup(&F)];
+      Encoder& encoder = slot.encoder;
+      encoder.cache = this;
+      encoder.function(&F);
+      for (Function* dependency : dependencies) {
+        encoder.function(dependency);
+      }
+
+      // Branches first, so the queries and contexts they use are known
+      std::string branches;
+      ByteWriter branchWriter(branches);
+      DenseMap<QueryID, unsigned> queryIndex;
+      std::vector<QueryID> queries;
+      DenseMap<CallContext, unsigned> contextIndex;
+      std::vector<CallContext> contexts;
+      branchWriter.u32(branchNodes.size());
+      for (unsigned branch = 0; branch < branchNodes.size(); ++branch) {
+        encoder.node(branchWriter, branchNodes[branch]);
+        const InfeasiblePathResult& result = results[branch];
+        for (const std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>* s :
+             { &result.startSet, &result.presentSet, &result.endSet }) {
+          branchWriter.u32(s->size());
+          for (const auto& edge : *s) {
+            encoder.node(branchWriter, edge.first.first);
+            encoder.node(branchWriter, edge.first.second);
+            branchWriter.u32(edge.second.size());
+            for (const std::tuple<QueryID, QueryResolution, CallContext>& t : edge.second) {
+              branchWriter.u32(indexOf(queryIndex, queries, std::get<0>(t)));
+              branchWriter.u8(std::get<1>(t));
+              branchWriter.u32(indexOf(contextIndex, contexts, std::get<2>(t)));
+            }
+          }
+        }
+      }
+
+      ByteWriter writer(slot.paths);
+      writer.u32(queries.size());
+      for (QueryID id : queries) {
+        const Query& q = state.queries.get(id);
+        encoder.value(writer, q.lhs);
+        writer.u8(q.queryOperator);
+        encoder.value(writer, q.rhs);
+        writer.u8(q.isSummaryNodeQuery);
+      }
+      writer.u32(contexts.size());
+      for (CallContext context : contexts) {
+        writer.u32(state.callStrings.depth(context));
+        for (; !state.callStrings.empty(context); context = state.callStrings.pop(context)) {
+          encoder.node(writer, state.callStrings.top(context));
+        }
+      }
+      slot.paths += branches;
+      slot.hasPaths = true;
+    }
+
+    // Encodes F's def-use pairs. dependencies are the functions the def-use walks entered.
+    void recordDefUses(Function& F, const SmallPtrSetImpl<Function*>& dependencies, const DefUseMap& defUses) {
+      Slot& slot = slots[functionIndex.lookup(&F)];
+      Encoder& encoder = slot.encoder;
+      encoder.cache = this;
+      for (Function* dependency : dependencies) {
+        encoder.function(dependency);
+      }
+
+      ByteWriter writer(slot.defUses);
+      writer.u32(defUses.numberOfVariables());
+      for (unsigned variable = 0; variable < defUses.numberOfVariables(); ++variable) {
+        encoder.value(writer, defUses.getVariable(variable));
+        ArrayRef<DefUseMap::DefUse> pairs = defUses.getDefUses(variable);
+        writer.u32(pairs.size());
+        for (DefUseMap::DefUse defUse : pairs) {
+          encoder.block(writer, defUse.first);
+          encoder.block(writer, defUse.second);
+        }
+      }
+      slot.hasDefUses = true;
+    }
+
+  private:
+    static constexpr const char Magic[] = "IPDCACHE";
+    static const unsigned Version = 3;
+    static const unsigned None = ~0u;
+
+    enum ValueKind { NullValue, InstructionValue, ArgumentValue, GlobalValueRef, ConstantIntValue };
+
+    class ByteWriter {
+    public:
+      explicit ByteWriter(std::string& out) : out(&out) {}
+
+      void u8(unsigned value) {
+        out->push_back((char)value);
+      }
+
+      void u32(uint32_t value) {
+        for (unsigned byte = 0; byte < 4; ++byte) {
+          out->push_back((char)(value >> (byte * 8)));
+        }
+      }
+
+      void u64(uint64_t value) {
+        u32((uint32_t)value);
+        u32((uint32_t)(value >> 32));
+      }
+
+      void string(StringRef s) {
+        u32(s.size());
+        out->append(s.data(), s.size());
+      }
+
+    private:
+      std::string* out;
+    };
+
+    // Reads little-endian fields, and turns ok off instead of reading past the end.
+    class ByteReader {
+    public:
+      explicit ByteReader(StringRef data) : data(data), offset(0), ok(true) {}
+
+      StringRef bytes(uint64_t size) {
+        if (!ok || size > data.size() - offset) {
+          ok = false;
+          return StringRef();
+        }
+        StringRef result = data.substr(offset, size);
+        offset += size;
+        return result;
+      }
+
+      unsigned u8() {
+        StringRef b = bytes(1);
+        return ok ? (unsigned char)b[0] : 0;
+      }
+
+      uint32_t u32() {
+        StringRef b = bytes(4);
+        uint32_t value = 0;
+        for (unsigned byte = 0; ok && byte < 4; ++byte) {
+          value |= (uint32_t)(unsigned char)b[byte] << (byte * 8);
+        }
+        return value;
+      }
+
+      uint64_t u64() {
+        uint64_t low = u32();
+        return low | ((uint64_t)u32() << 32);
+      }
+
+      StringRef string() {
+        return bytes(u32());
+      }
+
+      // Number of elements to follow, each of which takes at least a byte.
+      uint32_t count() {
+        uint32_t value = u32();
+        if (value > data.size() - offset) {
+          ok = false;
+          return 0;
+        }
+        return value;
+      }
+
+      StringRef data;
+      size_t offset;
+      bool ok;
+    };
+
+    // Writes references to functions as indices into the entry's dependency table, which grows as
+    // functions are referenced. ok turns off if a value cannot be stored.
+    struct Encoder {
+      Encoder() : cache(nullptr), ok(true) {}
+
+      const ResultCache* cache;
+      DenseMap<Function*, unsigned> functionIndex;
+      std::vector<Function*> functions;
+      bool ok;
+
+      unsigned function(Function* F) {
+        std::pair<DenseMap<Function*, unsigned>::iterator, bool> inserted = functionIndex.insert(std::make_pair(F, (unsigned)functions.size()));
+        if (inserted.second) {
+          functions.push_back(F);
+          ok &= F->hasName();
+        }
+        return inserted.first->second;
+      }
+
+      void block(ByteWriter& writer, BasicBlock* B) {
+        writer.u32(function(B->getParent()));
+        writer.u32(cache->blockIndex.lookup(B));
+      }
+
+      void node(ByteWriter& writer, Node* n) {
+        if (n == nullptr) {
+          writer.u32(None);
+          return;
+        }
+        block(writer, n->basicBlock);
+        unsigned position = None;
+        if (n->programPointInBlock != nullptr) {
+          ArrayRef<Instruction*> calls = cache->graph->getCallSites().getCallsIn(n->basicBlock);
+          position = std::find(calls.begin(), calls.end(), n->programPointInBlock) - calls.begin();
+        }
+        writer.u32(position);
+      }
+
+      void value(ByteWriter& writer, Value* v) {
+        if (v == nullptr) {
+          writer.u8(NullValue);
+        }
+        else if (Instruction* i = dyn_cast<Instruction>(v)) {
+          writer.u8(InstructionValue);
+          writer.u32(function(i->getFunction()));
+          writer.u32(cache->instructionIndex.lookup(i));
+        }
+        else if (Argument* a = dyn_cast<Argument>(v)) {
+          writer.u8(ArgumentValue);
+          writer.u32(function(a->getParent()));
+          writer.u32(a->getArgNo());
+        }
+        else if (GlobalValue* g = dyn_cast<GlobalValue>(v)) {
+          writer.u8(GlobalValueRef);
+          writer.string(g->getName());
+          ok &= g->hasName();
+        }
+        else if (ConstantInt* c = dyn_cast<ConstantInt>(v)) {
+          writer.u8(ConstantIntValue);
+          writer.u32(c->getBitWidth());
+          writer.u64(c->getValue().getLimitedValue());
+          ok &= c->getBitWidth() <= 64;
+        }
+        else {
+          ok = false;
+        }
+      }
+    };
+
+    struct Slot;
+
+    // Reads what Encoder wrote, given the functions of the entry's dependency table.
+    struct Decoder {
+      Decoder(const ResultCache& cache, ByteReader& reader, const std::vector<Function*>& functions)
+        : cache(&cache), reader(&reader), functions(&functions) {}
+
+      const ResultCache* cache;
+      ByteReader* reader;
+      const std::vector<Function*>* functions;
+
+      const Slot* slotOf(unsigned function) {
+        if (function >= functions->size()) {
+          reader->ok = false;
+          return nullptr;
+        }
+        return &cache->slots[cache->functionIndex.lookup((*functions)[function])];
+      }
+
+      template <typename T>
+      T* at(const std::vector<T*>& v, unsigned index) {
+        if (index >= v.size()) {
+          reader->ok = false;
+          return nullptr;
+        }
+        return v[index];
+      }
+
+      BasicBlock* block() {
+        const Slot* slot = slotOf(reader->u32());
+        unsigned index = reader->u32();
+        return slot == nullptr ? nullptr : at(slot->blocks, index);
+      }
+
+      Node* node() {
+        unsigned function = reader->u32();
+        if (function == None) {
+          return nullptr;
+        }
+        const Slot* slot = slotOf(function);
+        unsigned index = reader->u32();
+        unsigned position = reader->u32();
+        BasicBlock* B = slot == nullptr ? nullptr : at(slot->blocks, index);
+        if (B == nullptr) {
+          reader->ok = false;
+          return nullptr;
+        }
+        Instruction* programPoint = nullptr;
+        if (position != None) {
+          ArrayRef<Instruction*> calls = cache->graph->getCallSites().getCallsIn(B);
+          if (position >= calls.size()) {
+            reader->ok = false;
+            return nullptr;
+          }
+          programPoint = calls[position];
+        }
+        return cache->graph->getNode(B, programPoint);
+      }
+
+      Value* value() {
+        switch (reader->u8()) {
+        case NullValue:
+          return nullptr;
+        case InstructionValue: {
+          const Slot* slot = slotOf(reader->u32());
+          unsigned index = reader->u32();
+          return slot == nullptr ? nullptr : at(slot->instructions, index);
+        }
+        case ArgumentValue: {
+          const Slot* slot = slotOf(reader->u32());
+          unsigned index = reader->u32();
+          if (slot == nullptr || index >= slot->function->arg_size()) {
+            reader->ok = false;
+            return nullptr;
+          }
+          return slot->function->arg_begin() + index;
+        }
+        case GlobalValueRef: {
+          GlobalValue* g = cache->module->getNamedValue(reader->string());
+          reader->ok &= g != nullptr;
+          return g;
+        }
+        case ConstantIntValue: {
+          unsigned width = reader->u32();
+          uint64_t value = reader->u64();
+          if (width == 0 || width > 64) {
+            reader->ok = false;
+            return nullptr;
+          }
+          return ConstantInt::get(IntegerType::get(cache->module->getContext(), width), value);
+        }
+        default:
+          reader->ok = false;
+          return nullptr;
+        }
+      }
+
+      void edgeSets(std::map<std::pair<Node*, Node*>, std::set<std::tuple<QueryID, QueryResolution, CallContext>>>& s,
+                    const std::vector<QueryID>& queries, const std::vector<CallContext>& contexts) {
+        unsigned numberOfEdges = reader->u32();
+        for (unsigned edge = 0; edge < numberOfEdges && reader->ok; ++edge) {
+          Node* from = node();
+          Node* to = node();
+          std::set<std::tuple<QueryID, QueryResolution, CallContext>>& tuples = s[std::make_pair(from, to)];
+          unsigned numberOfTuples = reader->u32();
+          for (unsigned t = 0; t < numberOfTuples && reader->ok; ++t) {
+            unsigned query = reader->u32();
+            unsigned resolution = reader->u8();
+            unsigned context = reader->u32();
+            if (query >= queries.size() || resolution > QueryUndefined || context >= contexts.size()) {
+              reader->ok = false;
+              return;
+            }
+            tuples.insert(std::make_tuple(queries[query], (QueryResolution)resolution, contexts[context]));
+          }
+        }
+      }
+    };
+
+    struct Slot {
+      Slot() : function(nullptr), hash(0), isReused(false), defUsesOffset(0), hasPaths(false), hasDefUses(false) {}
+
+      Function* function;
+      uint64_t hash;
+      std::vector<BasicBlock*> blocks;
+      std::vector<Instruction*> instructions;
+
+      // Entry of the loaded file the results were decoded from
+      bool isReused;
+      StringRef entry;
+      size_t defUsesOffset;
+
+      // Results of this run, encoded as they are recorded
+      Encoder encoder;
+      std::string paths;
+      std::string defUses;
+      bool hasPaths;
+      bool hasDefUses;
+    };
+
+    Module* module;
+    ICFG* graph;
+    std::vector<Slot> slots;
+    DenseMap<Function*, unsigned> functionIndex;
+    DenseMap<BasicBlock*, unsigned> blockIndex;
+    DenseMap<Instruction*, unsigned> instructionIndex;
+    DenseMap<GlobalVariable*, uint64_t> globalHashes;
+    std::unique_ptr<sys::fs::mapped_file_region> mapping;
+    StringMap<StringRef> entries;
+
+    template <typename T>
+    static unsigned indexOf(DenseMap<T, unsigned>& index, std::vector<T>& values, T value) {
+      std::pair<typename DenseMap<T, unsigned>::iterator, bool> inserted = index.insert(std::make_pair(value, (unsigned)values.size()));
+      if (inserted.second) {
+        values.push_back(value);
+      }
+      return inserted.first->second;
+    }
+
+    // Reads the dependency table and checks every function in it still hashes the same.
+    bool readDependencies(ByteReader& reader, std::vector<Function*>& functions) const {
+      unsigned numberOfFunctions = reader.u32();
+      for (unsigned i = 0; i < numberOfFunctions && reader.ok; ++i) {
+        StringRef name = reader.string();
+        uint64_t hash = reader.u64();
+        Function* F = module->getFunction(name);
+        if (!reader.ok || F == nullptr || slots[functionIndex.lookup(F)].hash != hash) {
+          return false;
+        }
+        functions.push_back(F);
+      }
+      return reader.ok;
+    }
+
+    std::string encodeEntry(const Slot& slot) const {
+      std::string entry;
+      ByteWriter writer(entry);
+      writer.string(slot.function->getName());
+      writer.u32(slot.encoder.functions.size());
+      for (Function* F : slot.encoder.functions) {
+        writer.string(F->getName());
+        writer.u64(slots[functionIndex.lookup(F)].hash);
+      }
+      entry += slot.paths;
+      entry += slot.defUses;
+      return entry;
+    }
+
+    uint64_t hashFunction(Function& F) const {
+      StructuralHash hash;
+      hash.add(F.getName());
+      hash.add(F.isDeclaration());
+      hashType(hash, F.getReturnType());
+      for (Argument& argument : F.args()) {
+        hash.add(argument.getName());
+        hashType(hash, argument.getType());
+      }
+      for (BasicBlock& B : F) {
+        hash.add(B.getName());
+        hash.add(B.size());
+        for (Instruction& I : B) {
+          hash.add(I.getOpcode());
+          hash.add(I.getName());
+          hashType(hash, I.getType());
+          if (CmpInst* cmp = dyn_cast<CmpInst>(&I)) {
+            hash.add(cmp->getPredicate());
+          }
+          hash.add(I.getNumOperands());
+          for (Value* operand : I.operands()) {
+            hashValue(hash, operand);
+          }
+        }
+      }
+
+      std::vector<StringRef> callers;
+      for (CallInst* call : graph->getCallSites().getCallSitesOf(&F)) {
+        callers.push_back(call->getFunction()->getName());
+      }
+      std::sort(callers.begin(), callers.end());
+      hash.add(callers.size());
+      for (StringRef caller : callers) {
+        hash.add(caller);
+      }
+      return hash.get();
+    }
+
+    void hashValue(StructuralHash& hash, Value* v) const {
+      hash.add(v->getValueID());
+      hashType(hash, v->getType());
+      if (Instruction* i = dyn_cast<Instruction>(v)) {
+        hash.add(instructionIndex.lookup(i));
+      }
+      else if (BasicBlock* b = dyn_cast<BasicBlock>(v)) {
+        hash.add(blockIndex.lookup(b));
+      }
+      else if (Argument* a = dyn_cast<Argument>(v)) {
+        hash.add(a->getArgNo());
+      }
+      else if (GlobalValue* g = dyn_cast<GlobalValue>(v)) {
+        hash.add(g->getName());
+        if (GlobalVariable* variable = dyn_cast<GlobalVariable>(g)) {
+          hash.add(globalHashes.lookup(variable));
+        }
+        // A walk that never enters a declared callee does not depend on it, yet the callee gaining
+        // a body gives the call an exit node to walk into.
+        else if (Function* function = dyn_cast<Function>(g)) {
+          hash.add(function->isDeclaration());
+        }
+      }
+      else if (ConstantInt* c = dyn_cast<ConstantInt>(v)) {
+        hashAPInt(hash, c->getValue());
+      }
+      else if (ConstantFP* c = dyn_cast<ConstantFP>(v)) {
+        hashAPInt(hash, c->getValueAPF().bitcastToAPInt());
+      }
+      else if (Constant* c = dyn_cast<Constant>(v)) {
+        if (ConstantExpr* expression = dyn_cast<ConstantExpr>(c)) {
+          hash.add(expression->getOpcode());
+        }
+        hash.add(c->getNumOperands());
+        for (Value* operand : c->operands()) {
+          hashValue(hash, operand);
+        }
+      }
+    }
+
+    uint64_t hashGlobal(GlobalVariable& G) const {
+      StructuralHash hash;
+      hash.add(G.isConstant());
+      hash.add(G.hasInitializer());
+      if (G.hasInitializer()) {
+        hashValue(hash, G.getInitializer());
+      }
+      return hash.get();
+    }
+
+    static void hashType(StructuralHash& hash, Type* type) {
+      hash.add(type->getTypeID());
+      if (type->isIntegerTy()) {
+        hash.add(type->getIntegerBitWidth());
+      }
+    }
+
+    static void hashAPInt(StructuralHash& hash, const APInt& value) {
+      hash.add(value.getBitWidth());
+      for (unsigned word = 0; word < value.getNumWords(); ++word) {
+        hash.add(value.getRawData()[word]);
+      }
+    }
+  };
+
+  constexpr const char ResultCache::Magic[];
+
+}
+
+#endif
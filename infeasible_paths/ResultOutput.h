@@ -0,0 +1,238 @@
+#ifndef RESULTOUTPUT_H_
+#define RESULTOUTPUT_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
+#include "DefUseMap.h"
+
+using namespace llvm;
+
+// How the passes write their results. Text is the listing they have always printed. On large
+// modules formatting every element costs more than finding it, so the others are meant for runs
+// that only need the totals or hand the results to another tool.
+enum OutputFormat {
+  OutputNone,
+  // Only the totals
+  OutputSummary,
+  OutputText,
+  OutputJSON,
+  // Starts with a table of the module's blocks, which the results refer to by number. Numbers and
+  // lengths are ULEB128.
+  OutputBinary
+};
+
+namespace {
+
+  // Values of the passes' output options.
+  inline cl::ValuesClass outputFormatValues() {
+    return cl::values(clEnumValN(OutputNone, "none", "Nothing"), clEnumValN(OutputSummary, "summary", "Totals only"),
+                      clEnumValN(OutputText, "text", "Readable listing"), clEnumValN(OutputJSON, "json", "JSON"),
+                      clEnumValN(OutputBinary, "binary", "Compact binary encoding"));
+  }
+
+  const char BinaryOutputMagic[] = "IPDRESULTS";
+  const unsigned BinaryOutputVersion = 1;
+
+  // Buffered stream onto the file at path, stdout for "-", or stderr if path is empty or the file
+  // cannot be created.
+  inline std::unique_ptr<raw_fd_ostream> openOutput(StringRef path) {
+    if (!path.empty()) {
+      std::error_code error;
+      std::unique_ptr<raw_fd_ostream> out(new raw_fd_ostream(path, error, sys::fs::F_None));
+      if (!error) {
+        return out;
+      }
+      errs() << "[!] Could not open " << path << ": " << error.message() << "\n";
+    }
+    return std::unique_ptr<raw_fd_ostream>(new raw_fd_ostream(2, false));
+  }
+
+  inline void writeJSONString(raw_ostream& out, StringRef s) {
+    out << '"';
+    for (unsigned char c : s) {
+      if (c == '"' || c == '\\') {
+        out << '\\' << c;
+      }
+      else if (c < 0x20) {
+        out << "\\u00" << hexdigit(c >> 4, true) << hexdigit(c & 15, true);
+      }
+      else {
+        out << c;
+      }
+    }
+    out << '"';
+  }
+
+  inline void writeBinaryString(raw_ostream& out, StringRef s) {
+    encodeULEB128(s.size(), out);
+    out << s;
+  }
+
+  // Writes results one record at a time in one of the formats other than text, which the passes
+  // print themselves. JSON output is an array of records. Binary output starts with the module's
+  // functions in order, each with its name, number of blocks and block names; records then refer
+  // to functions by their position in it and to blocks by their position across the module plus
+  // one, with 0 standing for no block.
+  class ResultWriter {
+  public:
+    ResultWriter(OutputFormat format, StringRef path) : format(format) {
+      if (format != OutputNone) {
+        out = openOutput(path);
+      }
+    }
+
+    ~ResultWriter() {
+      if (format == OutputJSON && started) {
+        *out << "]\n";
+      }
+    }
+
+    OutputFormat getFormat() const {
+      return format;
+    }
+
+    raw_ostream& stream() {
+      return *out;
+    }
+
+    // Starts the output of results of the given kind on M.
+    void begin(Module& M, StringRef kind) {
+      started = true;
+      if (format == OutputJSON) {
+        *out << "[";
+      }
+      else if (format == OutputBinary) {
+        *out << BinaryOutputMagic;
+        encodeULEB128(BinaryOutputVersion, *out);
+        writeBinaryString(*out, kind);
+
+        encodeULEB128(M.size(), *out);
+        for (Function& F : M) {
+          numberOfFunction.insert(std::make_pair(&F, (unsigned)numberOfFunction.size()));
+          writeBinaryString(*out, F.getName());
+          encodeULEB128(F.size(), *out);
+          for (BasicBlock& B : F) {
+            numberOfBlock.insert(std::make_pair(&B, (unsigned)numberOfBlock.size() + 1));
+            writeBinaryString(*out, B.getName());
+          }
+        }
+      }
+    }
+
+    void beginRecord() {
+      if (format == OutputJSON && numberOfRecords++ > 0) {
+        *out << ",";
+      }
+    }
+
+    void writeString(StringRef s) {
+      if (format == OutputJSON) {
+        writeJSONString(*out, s);
+      }
+      else {
+        writeBinaryString(*out, s);
+      }
+    }
+
+    void writeFunction(Function& F) {
+      if (format == OutputJSON) {
+        writeJSONString(*out, F.getName());
+      }
+      else {
+        encodeULEB128(numberOfFunction.lookup(&F), *out);
+      }
+    }
+
+    // A block is [function name, block name] in JSON.
+    void writeBlock(BasicBlock* B) {
+      if (format == OutputBinary) {
+        encodeULEB128(B == nullptr ? 0 : numberOfBlock.lookup(B), *out);
+      }
+      else if (B == nullptr) {
+        *out << "null";
+      }
+      else {
+        *out << "[";
+        writeJSONString(*out, B->getParent()->getName());
+        *out << ",";
+        writeJSONString(*out, B->getName());
+        *out << "]";
+      }
+    }
+
+  private:
+    OutputFormat format;
+    std::unique_ptr<raw_fd_ostream> out;
+    bool started = false;
+    unsigned numberOfRecords = 0;
+    DenseMap<Function*, unsigned> numberOfFunction;
+    DenseMap<BasicBlock*, unsigned> numberOfBlock;
+  };
+
+  // Writes the def-use pairs of F as one record. In JSON that is
+  // {"function": name, "variables": [{"name": name, "pairs": [[def block, use block], ...]}, ...]},
+  // and in binary the function, the number of variables, and for each its name, number of pairs
+  // and the def and use block of each pair.
+  inline void writeDefUses(ResultWriter& writer, Function& F, const DefUseMap& defUses) {
+    raw_ostream& out = writer.stream();
+    bool json = writer.getFormat() == OutputJSON;
+    writer.beginRecord();
+    if (json) {
+      out << "{\"function\":";
+    }
+    writer.writeFunction(F);
+    if (json) {
+      out << ",\"variables\":[";
+    }
+    else {
+      encodeULEB128(defUses.numberOfVariables(), out);
+    }
+
+    bool firstVariable = true;
+    for (unsigned variable : defUses.getVariablesByName()) {
+      ArrayRef<DefUseMap::DefUse> pairs = defUses.getDefUses(variable);
+      if (json) {
+        out << (firstVariable ? "{\"name\":" : ",{\"name\":");
+        firstVariable = false;
+      }
+      writer.writeString(defUses.getVariable(variable)->getName());
+      if (json) {
+        out << ",\"pairs\":[";
+      }
+      else {
+        encodeULEB128(pairs.size(), out);
+      }
+
+      for (unsigned i = 0; i < pairs.size(); ++i) {
+        if (json) {
+          out << (i == 0 ? "[" : ",[");
+        }
+        writer.writeBlock(pairs[i].first);
+        if (json) {
+          out << ",";
+        }
+        writer.writeBlock(pairs[i].second);
+        if (json) {
+          out << "]";
+        }
+      }
+      if (json) {
+        out << "]}";
+      }
+    }
+    if (json) {
+      out << "]}";
+    }
+  }
+
+}
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef STOREINDEX_H_
+#define STOREINDEX_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Instructions.h"
+
+#include <utility>
+
+using namespace llvm;
+
+// Last store to each pointer in a block or ICFG node, built once before the def-use walks so
+// finding a def on an edge is a hash lookup instead of a scan of the block's instructions. KeyT is
+// the BasicBlock for the intraprocedural analysis and Node::id for the interprocedural one.
+template <typename KeyT>
+class StoreIndex {
+public:
+  // Instructions of a key must be added in program order.
+  void add(KeyT key, Instruction* i) {
+    if (StoreInst* store = dyn_cast<StoreInst>(i)) {
+      lastStores[std::make_pair(key, store->getPointerOperand())] = store;
+    }
+  }
+
+  StoreInst* getLastStore(KeyT key, Value* pointer) const {
+    return lastStores.lookup(std::make_pair(key, pointer));
+  }
+
+  void clear() {
+    lastStores.clear();
+  }
+
+private:
+  DenseMap<std::pair<KeyT, Value*>, StoreInst*> lastStores;
+};
+
+#endif
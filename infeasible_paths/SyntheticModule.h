@@ -0,0 +1,167 @@
+#ifndef SYNTHETICMODULE_H_
+#define SYNTHETICMODULE_H_
+
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Shape of a generated module. main calls a chain of callDepth functions, each calling the next one
+// from fanIn call sites, and with recursion the last one also calls itself. Every function tests
+// each of correlatedBranches globals twice inside loopDepth nested loops: the first test stores a
+// different constant to the global on each side, so the second test is decided by the path taken
+// through the first, and the calls between the two tests make the queries walk through callees.
+struct SyntheticModuleShape {
+  unsigned correlatedBranches;
+  unsigned loopDepth;
+  unsigned callDepth;
+  unsigned fanIn;
+  bool recursion;
+};
+
+namespace {
+
+  // Builds modules in the shape clang -O0 gives the test programs: variables are allocas and
+  // globals, read and written with loads and stores, and every conditional branch tests a load.
+  class SyntheticModuleBuilder {
+  public:
+    SyntheticModuleBuilder(LLVMContext& context, const SyntheticModuleShape& shape)
+      : context(context), shape(shape), builder(context), int32(Type::getInt32Ty(context)) {}
+
+    std::unique_ptr<Module> build() {
+      std::unique_ptr<Module> module(new Module("synthetic", context));
+      globals.clear();
+      for (unsigned j = 0; j < shape.correlatedBranches; ++j) {
+        globals.push_back(new GlobalVariable(*module, int32, false, GlobalValue::ExternalLinkage, ConstantInt::get(int32, 0), "g" + Twine(j)));
+      }
+
+      FunctionType* type = FunctionType::get(Type::getVoidTy(context), false);
+      std::vector<Function*> functions;
+      for (unsigned depth = 0; depth <= shape.callDepth; ++depth) {
+        std::string name = depth == 0 ? std::string("main") : ("f" + Twine(depth)).str();
+        functions.push_back(Function::Create(type, GlobalValue::ExternalLinkage, name, module.get()));
+      }
+      for (unsigned depth = 0; depth <= shape.callDepth; ++depth) {
+        Function* callee = depth < shape.callDepth ? functions[depth + 1] : nullptr;
+        buildBody(*functions[depth], callee, depth == shape.callDepth && shape.recursion);
+      }
+      return module;
+    }
+
+  private:
+    LLVMContext& context;
+    SyntheticModuleShape shape;
+    IRBuilder<> builder;
+    IntegerType* int32;
+    std::vector<GlobalVariable*> globals;
+
+    ConstantInt* constant(unsigned value) {
+      return ConstantInt::get(int32, value);
+    }
+
+    // Branches on whether variable holds value, and leaves the builder at the start of the then
+    // block. Returns the else block and sets join to the block both sides continue in.
+    BasicBlock* branchOnEquals(Value* variable, unsigned value, const Twine& name, BasicBlock*& join) {
+      Function* F = builder.GetInsertBlock()->getParent();
+      BasicBlock* thenBlock = BasicBlock::Create(context, name + ".then", F);
+      BasicBlock* elseBlock = BasicBlock::Create(context, name + ".else", F);
+      join = BasicBlock::Create(context, name + ".end", F);
+      Value* loaded = builder.CreateLoad(int32, variable);
+      builder.CreateCondBr(builder.CreateICmpEQ(loaded, constant(value), "cmp"), thenBlock, elseBlock);
+      builder.SetInsertPoint(thenBlock);
+      return elseBlock;
+    }
+
+    void buildBody(Function& F, Function* callee, bool callsItself) {
+      builder.SetInsertPoint(BasicBlock::Create(context, "entry", &F));
+      Value* x = builder.CreateAlloca(int32, nullptr, "x");
+      std::vector<Value*> counters;
+      for (unsigned level = 0; level < shape.loopDepth; ++level) {
+        counters.push_back(builder.CreateAlloca(int32, nullptr, "i" + Twine(level)));
+      }
+      builder.CreateStore(constant(0), x);
+
+      // Loop headers and latches, outermost first
+      std::vector<BasicBlock*> headers;
+      std::vector<BasicBlock*> exits;
+      for (unsigned level = 0; level < shape.loopDepth; ++level) {
+        BasicBlock* header = BasicBlock::Create(context, "for.cond" + Twine(level), &F);
+        BasicBlock* body = BasicBlock::Create(context, "for.body" + Twine(level), &F);
+        BasicBlock* exit = BasicBlock::Create(context, "for.end" + Twine(level), &F);
+        builder.CreateStore(constant(0), counters[level]);
+        builder.CreateBr(header);
+        builder.SetInsertPoint(header);
+        Value* counter = builder.CreateLoad(int32, counters[level]);
+        builder.CreateCondBr(builder.CreateICmpSLT(counter, constant(4), "cmp"), body, exit);
+        builder.SetInsertPoint(body);
+        headers.push_back(header);
+        exits.push_back(exit);
+      }
+
+      for (unsigned j = 0; j < shape.correlatedBranches; ++j) {
+        BasicBlock* join;
+        BasicBlock* elseBlock = branchOnEquals(globals[j], j, "if" + Twine(j), join);
+        builder.CreateStore(constant(1), x);
+        builder.CreateStore(constant(j), globals[j]);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(elseBlock);
+        builder.CreateStore(constant(2), x);
+        builder.CreateStore(constant(j + 1), globals[j]);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(join);
+      }
+
+      if (callee != nullptr) {
+        for (unsigned call = 0; call < shape.fanIn; ++call) {
+          builder.CreateCall(callee);
+        }
+      }
+      if (callsItself && !globals.empty()) {
+        BasicBlock* join;
+        BasicBlock* elseBlock = branchOnEquals(globals[0], 0, "recurse", join);
+        builder.CreateCall(&F);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(elseBlock);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(join);
+      }
+
+      for (unsigned j = 0; j < shape.correlatedBranches; ++j) {
+        BasicBlock* join;
+        BasicBlock* elseBlock = branchOnEquals(globals[j], j, "if.again" + Twine(j), join);
+        Value* loaded = builder.CreateLoad(int32, x);
+        builder.CreateStore(builder.CreateAdd(loaded, constant(1), "add"), x);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(elseBlock);
+        builder.CreateStore(constant(0), x);
+        builder.CreateBr(join);
+        builder.SetInsertPoint(join);
+      }
+
+      // Close the loops from the innermost out
+      for (unsigned level = shape.loopDepth; level-- > 0;) {
+        BasicBlock* latch = BasicBlock::Create(context, "for.inc" + Twine(level), &F);
+        builder.CreateBr(latch);
+        builder.SetInsertPoint(latch);
+        Value* counter = builder.CreateLoad(int32, counters[level]);
+        builder.CreateStore(builder.CreateAdd(counter, constant(1), "inc"), counters[level]);
+        builder.CreateBr(headers[level]);
+        builder.SetInsertPoint(exits[level]);
+      }
+      builder.CreateRetVoid();
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef TRANSFERFUNCTIONCACHE_H_
+#define TRANSFERFUNCTIONCACHE_H_
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <utility>
+#include <vector>
+
+#include "QueryInterner.h"
+
+using namespace llvm;
+
+// Memoized effect of one node on one query. The resolution and the substitution are filled in
+// lazily and independently, since a query the node resolves is never substituted through it.
+template <typename ResolutionT>
+struct TransferFunction {
+  TransferFunction() : hasResolution(false), isResolved(false), resolution(), hasSubstitution(false), substitutedQuery(0) {}
+
+  bool hasResolution;
+  bool isResolved;
+  ResolutionT resolution;
+
+  bool hasSubstitution;
+  // Query at the top of the node.
+  QueryID substitutedQuery;
+  // Query handed to each predecessor, in the node's predecessor order. Kept in a std::vector so the
+  // elements stay where they are when the cache rehashes.
+  std::vector<QueryID> predecessorQueries;
+};
+
+// Transfer functions keyed on (node, query ID). NodeKeyT is Node::id for the interprocedural
+// detector and the BasicBlock for the intraprocedural one.
+template <typename NodeKeyT, typename ResolutionT>
+class TransferFunctionCache {
+public:
+  TransferFunction<ResolutionT>& get(NodeKeyT node, QueryID query) {
+    return functions[std::make_pair(node, query)];
+  }
+
+  // The transfer function get would return, or nullptr if it was never asked for. Only reads the
+  // cache, so any number of threads may call it while no one calls get.
+  const TransferFunction<ResolutionT>* lookup(NodeKeyT node, QueryID query) const {
+    typename DenseMap<std::pair<NodeKeyT, QueryID>, TransferFunction<ResolutionT>>::const_iterator function =
+      functions.find(std::make_pair(node, query));
+    return function == functions.end() ? nullptr : &function->second;
+  }
+
+  unsigned size() const {
+    return functions.size();
+  }
+
+private:
+  DenseMap<std::pair<NodeKeyT, QueryID>, TransferFunction<ResolutionT>> functions;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef WORKSTEALINGPOOL_H_
+#define WORKSTEALINGPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed set of independent tasks, numbered 0..n-1, on a number of threads. Each worker
+// starts with a contiguous share of the tasks and takes them from the front of its own deque; once
+// that is empty it steals from the back of the other workers' deques, so a few expensive tasks do
+// not leave the other threads idle. Tasks are told which worker runs them, so callers can keep
+// per-worker state without locking. The worker threads are started once with the pool and wait for
+// the next run in between, so a pool kept across many small runs does not pay for thread creation
+// on each of them.
+class WorkStealingPool {
+public:
+  typedef std::function<void(unsigned task, unsigned worker)> Task;
+
+  explicit WorkStealingPool(unsigned numberOfThreads)
+    : numberOfThreads(numberOfThreads == 0 ? 1 : numberOfThreads), queues(this->numberOfThreads), task(nullptr), generation(0),
+      busyWorkers(0), stopping(false) {
+    for (unsigned worker = 1; worker < this->numberOfThreads; ++worker) {
+      threads.emplace_back([this, worker]() { serve(worker); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  unsigned size() const {
+    return numberOfThreads;
+  }
+
+  // Runs every task and returns once all of them are done. With a single thread, or fewer than two
+  // tasks, the tasks run in order on the calling thread as worker 0 and the other workers stay
+  // asleep. Only one thread may run tasks at a time, and tasks must not call run.
+  void run(unsigned numberOfTasks, const Task& task) {
+    if (numberOfThreads == 1 || numberOfTasks < 2) {
+      for (unsigned i = 0; i < numberOfTasks; ++i) {
+        task(i, 0);
+      }
+      return;
+    }
+
+    // The workers are asleep until generation moves, so the deques can be filled without locking
+    for (unsigned i = 0; i < numberOfTasks; ++i) {
+      queues[(unsigned long long)i * numberOfThreads / numberOfTasks].tasks.push_back(i);
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      this->task = &task;
+      busyWorkers = numberOfThreads - 1;
+      ++generation;
+    }
+    wake.notify_all();
+
+    work(0, task);
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this]() { return busyWorkers == 0; });
+    this->task = nullptr;
+  }
+
+private:
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<unsigned> tasks;
+  };
+
+  unsigned numberOfThreads;
+  std::vector<WorkQueue> queues;
+  std::vector<std::thread> threads;
+
+  // Guards the fields below. A run bumps generation to wake the workers, and each worker that finds
+  // no task left decrements busyWorkers.
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+  const Task* task;
+  unsigned long long generation;
+  unsigned busyWorkers;
+  bool stopping;
+
+  // Body of worker thread `worker`: runs its share of each run until the pool is destroyed.
+  void serve(unsigned worker) {
+    unsigned long long served = 0;
+    while (true) {
+      const Task* current;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [this, served]() { return stopping || generation != served; });
+        if (stopping) {
+          return;
+        }
+        served = generation;
+        current = task;
+      }
+
+      work(worker, *current);
+
+      std::lock_guard<std::mutex> guard(lock);
+      if (--busyWorkers == 0) {
+        done.notify_one();
+      }
+    }
+  }
+
+  void work(unsigned worker, const Task& task) {
+    unsigned next;
+    while (takeOwn(queues[worker], next) || steal(worker, next)) {
+      task(next, worker);
+    }
+  }
+
+  static bool takeOwn(WorkQueue& queue, unsigned& next) {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    next = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  // No tasks are added once the pool is running, so finding every other deque empty means the
+  // worker is done.
+  bool steal(unsigned worker, unsigned& next) {
+    for (unsigned offset = 1; offset < queues.size(); ++offset) {
+      WorkQueue& victim = queues[(worker + offset) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (!victim.tasks.empty()) {
+        next = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+#endif
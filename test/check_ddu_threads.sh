@@ -0,0 +1,42 @@
+#!/bin/sh
+# Checks that -ddu-threads and -ddu-batch-variables do not change the def-use pairs IPDAnalyze finds.
+#
+# With four threads the def-use walks of functions detected by the same worker share its query state
+# and run at the same time; without batching each local variable is walked on its own. Every test
+# program must get the same pairs as with one thread and batching.
+#
+# Usage: test/check_ddu_threads.sh <build directory>
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <build directory>" >&2
+  exit 2
+fi
+
+analyze="$1/infeasible_paths/IPDAnalyze"
+tests=$(dirname "$0")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+status=0
+for bitcode in "$tests"/*.bc; do
+  name=$(basename "$bitcode" .bc)
+  if ! "$analyze" -ddu-threads=1 -ddu-output-file="$scratch/$name.1" "$bitcode" 2>/dev/null; then
+    echo "FAIL: $name: IPDAnalyze failed" >&2
+    status=1
+    continue
+  fi
+  for options in "-ddu-threads=4" "-ddu-threads=1 -ddu-batch-variables=false" "-ddu-threads=4 -ddu-batch-variables=false"; do
+    # Word splitting of $options is intended.
+    if ! "$analyze" $options -ddu-output-file="$scratch/$name.other" "$bitcode" 2>/dev/null; then
+      echo "FAIL: $name: IPDAnalyze $options failed" >&2
+      status=1
+    elif ! cmp -s "$scratch/$name.1" "$scratch/$name.other"; then
+      echo "FAIL: $name: def-use pairs differ with $options" >&2
+      diff "$scratch/$name.1" "$scratch/$name.other" >&2
+      status=1
+    fi
+  done
+done
+
+[ $status -eq 0 ] && echo "PASS"
+exit $status
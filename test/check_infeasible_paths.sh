@@ -0,0 +1,37 @@
+#!/bin/sh
+# Checks the -InfeasibleTest output of every test program that has a .expected file next to its .bc.
+#
+# The expected files are what the detector reported when they were checked in. Regenerate one with
+#   opt -enable-new-pm=0 -load <build directory>/infeasible_paths/libLLVMInfeasableTest.so -InfeasibleTest -disable-output test/X.bc 2> test/X.expected
+# (drop -enable-new-pm=0 before LLVM 13) when a change to the detector is meant to alter its results.
+#
+# Usage: test/check_infeasible_paths.sh <build directory>
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <build directory>" >&2
+  exit 2
+fi
+
+plugin="$1/infeasible_paths/libLLVMInfeasableTest.so"
+opt=${OPT:-opt}
+tests=$(dirname "$0")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+status=0
+for expected in "$tests"/*.expected; do
+  name=$(basename "$expected" .expected)
+  # Legacy pass, so that newer opts need -enable-new-pm=0; older ones do not know the flag.
+  if ! "$opt" -enable-new-pm=0 -load "$plugin" -InfeasibleTest -disable-output "$tests/$name.bc" 2> "$scratch/$name" &&
+     ! "$opt" -load "$plugin" -InfeasibleTest -disable-output "$tests/$name.bc" 2> "$scratch/$name"; then
+    echo "FAIL: $name: opt failed" >&2
+    status=1
+  elif ! cmp -s "$expected" "$scratch/$name"; then
+    echo "FAIL: $name: infeasible paths differ from $name.expected" >&2
+    diff "$expected" "$scratch/$name" >&2
+    status=1
+  fi
+done
+
+[ $status -eq 0 ] && echo "PASS"
+exit $status
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Checks that -ipd-threads does not change what -InfeasibleTest reports.
+#
+# With one thread each function's branches go to one detector; with four they are split into
+# chunks that different workers detect with their own query state. Every test program must get
+# the same sets either way.
+#
+# Usage: test/check_ipd_threads.sh <build directory>
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <build directory>" >&2
+  exit 2
+fi
+
+plugin="$1/infeasible_paths/libLLVMInfeasableTest.so"
+opt=${OPT:-opt}
+tests=$(dirname "$0")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# Legacy pass, so that newer opts need -enable-new-pm=0; older ones do not know the flag.
+detect() {
+  "$opt" -enable-new-pm=0 -load "$plugin" -InfeasibleTest -disable-output "$@" 2> "$scratch/out" ||
+    "$opt" -load "$plugin" -InfeasibleTest -disable-output "$@" 2> "$scratch/out"
+}
+
+status=0
+for bitcode in "$tests"/*.bc; do
+  name=$(basename "$bitcode" .bc)
+  if ! detect -ipd-threads=1 "$bitcode" || ! mv "$scratch/out" "$scratch/$name.1" ||
+     ! detect -ipd-threads=4 "$bitcode" || ! mv "$scratch/out" "$scratch/$name.4"; then
+    echo "FAIL: $name: opt failed" >&2
+    status=1
+  elif ! cmp -s "$scratch/$name.1" "$scratch/$name.4"; then
+    echo "FAIL: $name: infeasible paths differ between -ipd-threads=1 and -ipd-threads=4" >&2
+    diff "$scratch/$name.1" "$scratch/$name.4" >&2
+    status=1
+  fi
+done
+
+[ $status -eq 0 ] && echo "PASS"
+exit $status
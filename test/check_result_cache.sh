@@ -0,0 +1,48 @@
+#!/bin/sh
+# Checks that -ddu-cache reuses a module's results for the same module and never hands them to
+# another.
+#
+# test_global_initializer_0 and test_global_initializer_5 differ only in the initializer of g, which
+# decides the infeasible paths of main. test_callee_declared and test_callee_defined differ only in
+# whether foo, which main calls, has a body. Analyzing the second of a pair with the cache the first
+# left behind must rewrite the cache exactly as a cold run of the second does.
+#
+# Reanalyzing test_global_initializer_5 with its own cache and a detection budget of one step must
+# not run out of budget: detection that runs again does and says so, results taken from the cache
+# do not.
+#
+# Usage: test/check_result_cache.sh <build directory>
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <build directory>" >&2
+  exit 2
+fi
+
+analyze="$1/infeasible_paths/IPDAnalyze"
+tests=$(dirname "$0")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+status=0
+for pair in test_global_initializer_0:test_global_initializer_5 test_callee_declared:test_callee_defined; do
+  before=${pair%:*}
+  after=${pair#*:}
+  "$analyze" -ddu-output=none -ddu-cache="$scratch/$after.cold" "$tests/$after.bc" 2>/dev/null || exit 1
+  "$analyze" -ddu-output=none -ddu-cache="$scratch/$after.warm" "$tests/$before.bc" 2>/dev/null || exit 1
+  "$analyze" -ddu-output=none -ddu-cache="$scratch/$after.warm" "$tests/$after.bc" 2>/dev/null || exit 1
+
+  if ! cmp -s "$scratch/$after.cold" "$scratch/$after.warm"; then
+    echo "FAIL: results cached for $before were reused for $after" >&2
+    status=1
+  fi
+done
+
+"$analyze" -ddu-output=none -ddu-cache="$scratch/test_global_initializer_5.cold" -ddu-max-detection-steps=1 \
+  "$tests/test_global_initializer_5.bc" 2> "$scratch/log" || exit 1
+if grep -q "ran out of budget" "$scratch/log"; then
+  echo "FAIL: results cached for test_global_initializer_5 were not reused for it" >&2
+  status=1
+fi
+
+[ $status -eq 0 ] && echo "PASS"
+exit $status
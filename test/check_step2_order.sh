@@ -0,0 +1,41 @@
+#!/bin/sh
+# Checks that -ipd-step2-order does not change what -InfeasibleTest reports.
+#
+# Step 2 only decides in which order the resolutions reach each node, and its join does not depend
+# on that order, so every test program must get the same sets from the legacy and the scc order.
+#
+# Usage: test/check_step2_order.sh <build directory>
+
+if [ $# -ne 1 ]; then
+  echo "usage: $0 <build directory>" >&2
+  exit 2
+fi
+
+plugin="$1/infeasible_paths/libLLVMInfeasableTest.so"
+opt=${OPT:-opt}
+tests=$(dirname "$0")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# Legacy pass, so that newer opts need -enable-new-pm=0; older ones do not know the flag.
+detect() {
+  "$opt" -enable-new-pm=0 -load "$plugin" -InfeasibleTest -disable-output "$@" 2> "$scratch/out" ||
+    "$opt" -load "$plugin" -InfeasibleTest -disable-output "$@" 2> "$scratch/out"
+}
+
+status=0
+for bitcode in "$tests"/*.bc; do
+  name=$(basename "$bitcode" .bc)
+  if ! detect -ipd-step2-order=legacy "$bitcode" || ! mv "$scratch/out" "$scratch/$name.legacy" ||
+     ! detect -ipd-step2-order=scc "$bitcode" || ! mv "$scratch/out" "$scratch/$name.scc"; then
+    echo "FAIL: $name: opt failed" >&2
+    status=1
+  elif ! cmp -s "$scratch/$name.legacy" "$scratch/$name.scc"; then
+    echo "FAIL: $name: infeasible paths differ between -ipd-step2-order=legacy and -ipd-step2-order=scc" >&2
+    diff "$scratch/$name.legacy" "$scratch/$name.scc" >&2
+    status=1
+  fi
+done
+
+[ $status -eq 0 ] && echo "PASS"
+exit $status
@@ -0,0 +1,12 @@
+int g = 0;
+int x = 0;
+
+void foo(void);
+
+int main() {
+  foo();
+  if (g == 0) {
+    x = 1;
+  }
+  return x;
+}
@@ -0,0 +1,14 @@
+int g = 0;
+int x = 0;
+
+void foo(void) {
+  g = 1;
+}
+
+int main() {
+  foo();
+  if (g == 0) {
+    x = 1;
+  }
+  return x;
+}
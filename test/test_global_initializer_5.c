@@ -0,0 +1,14 @@
+int g = 5;
+int x = 0;
+
+int main() {
+  x = 1;
+  if (g == 0) {
+    x = 2;
+  }
+
+  if (g == 0) {
+    return x;
+  }
+  return 0;
+}
@@ -0,0 +1,177 @@
+; IPDBenchmark -print-modules -scale=fan-in -sizes=2 -branches=1 -loops=1 -call-depth=2
+; ModuleID = 'synthetic'
+source_filename = "synthetic"
+
+@g0 = global i32 0
+
+define void @main() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  call void @f1()
+  call void @f1()
+  %2 = load i32, i32* @g0, align 4
+  %cmp2 = icmp eq i32 %2, 0
+  br i1 %cmp2, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %if0.end
+  %3 = load i32, i32* %x, align 4
+  %add = add i32 %3, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %if0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again0.end
+  %4 = load i32, i32* %i0, align 4
+  %inc = add i32 %4, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}
+
+define void @f1() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  call void @f2()
+  call void @f2()
+  %2 = load i32, i32* @g0, align 4
+  %cmp2 = icmp eq i32 %2, 0
+  br i1 %cmp2, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %if0.end
+  %3 = load i32, i32* %x, align 4
+  %add = add i32 %3, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %if0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again0.end
+  %4 = load i32, i32* %i0, align 4
+  %inc = add i32 %4, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}
+
+define void @f2() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  %2 = load i32, i32* @g0, align 4
+  %cmp2 = icmp eq i32 %2, 0
+  br i1 %cmp2, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %if0.end
+  %3 = load i32, i32* %x, align 4
+  %add = add i32 %3, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %if0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again0.end
+  %4 = load i32, i32* %i0, align 4
+  %inc = add i32 %4, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}
@@ -0,0 +1,280 @@
+; IPDBenchmark -print-modules -scale=fan-in -sizes=2 -branches=2 -loops=1 -call-depth=2 -recursion
+; ModuleID = 'synthetic'
+source_filename = "synthetic"
+
+@g0 = global i32 0
+@g1 = global i32 0
+
+define void @main() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  %2 = load i32, i32* @g1, align 4
+  %cmp2 = icmp eq i32 %2, 1
+  br i1 %cmp2, label %if1.then, label %if1.else
+
+if1.then:                                         ; preds = %if0.end
+  store i32 1, i32* %x, align 4
+  store i32 1, i32* @g1, align 4
+  br label %if1.end
+
+if1.else:                                         ; preds = %if0.end
+  store i32 2, i32* %x, align 4
+  store i32 2, i32* @g1, align 4
+  br label %if1.end
+
+if1.end:                                          ; preds = %if1.else, %if1.then
+  call void @f1()
+  call void @f1()
+  %3 = load i32, i32* @g0, align 4
+  %cmp3 = icmp eq i32 %3, 0
+  br i1 %cmp3, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %if1.end
+  %4 = load i32, i32* %x, align 4
+  %add = add i32 %4, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %if1.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  %5 = load i32, i32* @g1, align 4
+  %cmp4 = icmp eq i32 %5, 1
+  br i1 %cmp4, label %if.again1.then, label %if.again1.else
+
+if.again1.then:                                   ; preds = %if.again0.end
+  %6 = load i32, i32* %x, align 4
+  %add5 = add i32 %6, 1
+  store i32 %add5, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.else:                                   ; preds = %if.again0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.end:                                    ; preds = %if.again1.else, %if.again1.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again1.end
+  %7 = load i32, i32* %i0, align 4
+  %inc = add i32 %7, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}
+
+define void @f1() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  %2 = load i32, i32* @g1, align 4
+  %cmp2 = icmp eq i32 %2, 1
+  br i1 %cmp2, label %if1.then, label %if1.else
+
+if1.then:                                         ; preds = %if0.end
+  store i32 1, i32* %x, align 4
+  store i32 1, i32* @g1, align 4
+  br label %if1.end
+
+if1.else:                                         ; preds = %if0.end
+  store i32 2, i32* %x, align 4
+  store i32 2, i32* @g1, align 4
+  br label %if1.end
+
+if1.end:                                          ; preds = %if1.else, %if1.then
+  call void @f2()
+  call void @f2()
+  %3 = load i32, i32* @g0, align 4
+  %cmp3 = icmp eq i32 %3, 0
+  br i1 %cmp3, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %if1.end
+  %4 = load i32, i32* %x, align 4
+  %add = add i32 %4, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %if1.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  %5 = load i32, i32* @g1, align 4
+  %cmp4 = icmp eq i32 %5, 1
+  br i1 %cmp4, label %if.again1.then, label %if.again1.else
+
+if.again1.then:                                   ; preds = %if.again0.end
+  %6 = load i32, i32* %x, align 4
+  %add5 = add i32 %6, 1
+  store i32 %add5, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.else:                                   ; preds = %if.again0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.end:                                    ; preds = %if.again1.else, %if.again1.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again1.end
+  %7 = load i32, i32* %i0, align 4
+  %inc = add i32 %7, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}
+
+define void @f2() {
+entry:
+  %x = alloca i32, align 4
+  %i0 = alloca i32, align 4
+  store i32 0, i32* %x, align 4
+  store i32 0, i32* %i0, align 4
+  br label %for.cond0
+
+for.cond0:                                        ; preds = %for.inc0, %entry
+  %0 = load i32, i32* %i0, align 4
+  %cmp = icmp slt i32 %0, 4
+  br i1 %cmp, label %for.body0, label %for.end0
+
+for.body0:                                        ; preds = %for.cond0
+  %1 = load i32, i32* @g0, align 4
+  %cmp1 = icmp eq i32 %1, 0
+  br i1 %cmp1, label %if0.then, label %if0.else
+
+for.end0:                                         ; preds = %for.cond0
+  ret void
+
+if0.then:                                         ; preds = %for.body0
+  store i32 1, i32* %x, align 4
+  store i32 0, i32* @g0, align 4
+  br label %if0.end
+
+if0.else:                                         ; preds = %for.body0
+  store i32 2, i32* %x, align 4
+  store i32 1, i32* @g0, align 4
+  br label %if0.end
+
+if0.end:                                          ; preds = %if0.else, %if0.then
+  %2 = load i32, i32* @g1, align 4
+  %cmp2 = icmp eq i32 %2, 1
+  br i1 %cmp2, label %if1.then, label %if1.else
+
+if1.then:                                         ; preds = %if0.end
+  store i32 1, i32* %x, align 4
+  store i32 1, i32* @g1, align 4
+  br label %if1.end
+
+if1.else:                                         ; preds = %if0.end
+  store i32 2, i32* %x, align 4
+  store i32 2, i32* @g1, align 4
+  br label %if1.end
+
+if1.end:                                          ; preds = %if1.else, %if1.then
+  %3 = load i32, i32* @g0, align 4
+  %cmp3 = icmp eq i32 %3, 0
+  br i1 %cmp3, label %recurse.then, label %recurse.else
+
+recurse.then:                                     ; preds = %if1.end
+  call void @f2()
+  br label %recurse.end
+
+recurse.else:                                     ; preds = %if1.end
+  br label %recurse.end
+
+recurse.end:                                      ; preds = %recurse.else, %recurse.then
+  %4 = load i32, i32* @g0, align 4
+  %cmp4 = icmp eq i32 %4, 0
+  br i1 %cmp4, label %if.again0.then, label %if.again0.else
+
+if.again0.then:                                   ; preds = %recurse.end
+  %5 = load i32, i32* %x, align 4
+  %add = add i32 %5, 1
+  store i32 %add, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.else:                                   ; preds = %recurse.end
+  store i32 0, i32* %x, align 4
+  br label %if.again0.end
+
+if.again0.end:                                    ; preds = %if.again0.else, %if.again0.then
+  %6 = load i32, i32* @g1, align 4
+  %cmp5 = icmp eq i32 %6, 1
+  br i1 %cmp5, label %if.again1.then, label %if.again1.else
+
+if.again1.then:                                   ; preds = %if.again0.end
+  %7 = load i32, i32* %x, align 4
+  %add6 = add i32 %7, 1
+  store i32 %add6, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.else:                                   ; preds = %if.again0.end
+  store i32 0, i32* %x, align 4
+  br label %if.again1.end
+
+if.again1.end:                                    ; preds = %if.again1.else, %if.again1.then
+  br label %for.inc0
+
+for.inc0:                                         ; preds = %if.again1.end
+  %8 = load i32, i32* %i0, align 4
+  %inc = add i32 %8, 1
+  store i32 %inc, i32* %i0, align 4
+  br label %for.cond0
+}